@@ -36,6 +36,19 @@ namespace Slicer {
 
 const std::vector<int> AppWindow::zoomLevels = {200, 300, 400, 550, 700};
 
+// Fast enough for the main loop, as only the inputs the session
+// already parsed are looked into, and without waiting for a save
+static std::vector<PdfSaver::SaveEstimate> estimateSaves(const PdfSaver::SaveData& saveData)
+{
+    PdfSaver saver{saveData};
+    std::vector<PdfSaver::SaveEstimate> result;
+
+    for (const PdfSaver::SaveOptions& options : Slicer::SaveFileDialog::estimatedOptions())
+        result.push_back(saver.estimate(options));
+
+    return result;
+}
+
 AppWindow::AppWindow(TaskRunner& taskRunner, SettingsManager& settingsManager)
     : m_taskRunner{taskRunner}
     , m_settingsManager{settingsManager}
@@ -66,7 +79,7 @@ AppWindow::~AppWindow()
 void AppWindow::setDocument(std::unique_ptr<Document> document)
 {
     m_view.cancelRenderingTasks();
-    m_taskRunner.waitUntilAllTasksFinish();
+    m_taskRunner.waitUntilTasksFinish(TaskRunner::Priority::Interactive);
 
     m_document = std::move(document);
     m_view.setDocument(*m_document, m_zoomLevel.currentLevel());
@@ -79,11 +92,14 @@ void AppWindow::setDocument(std::unique_ptr<Document> document)
     m_headerBar.enableZoomSlider();
     m_saveAction->set_enabled();
     m_zoomLevel.enable();
+
+    warmUpSaveSession();
 }
 
 bool AppWindow::on_delete_event(GdkEventAny*)
 {
-    if (m_isSavingDocument)
+    // The continuations of a background save, load or estimate refer to the window
+    if (m_isSavingDocument || m_isAddingFiles || m_isEstimatingSave)
         return true;
 
     if (m_isDocumentModified) {
@@ -100,7 +116,8 @@ bool AppWindow::on_delete_event(GdkEventAny*)
             return true;
 
         case Gtk::RESPONSE_YES: {
-            const bool success = showSaveFileDialogAndSave(SaveFileIn::Foreground);
+            const bool success = showSaveFileDialogAndSave(SaveFileIn::Foreground,
+                                                           estimateSaves(m_document->getSaveData()));
 
             return !success;
         }
@@ -214,18 +231,6 @@ void AppWindow::setupSignalHandlers()
         onZoomLevelChanged();
     });
 
-    m_savedDispatcher.connect([this]() {
-        m_savingRevealer.saved();
-        m_saveAction->set_enabled(true);
-        setModified(false);
-    });
-
-    m_savingFailedDispatcher.connect([this]() {
-        m_savingRevealer.set_reveal_child(false);
-        m_saveAction->set_enabled(true);
-        showSaveFileFailedErrorDialog();
-    });
-
     m_scroller.get_vadjustment()->signal_value_changed().connect([this]() {
         onScrollPositionChanged();
     });
@@ -234,6 +239,11 @@ void AppWindow::setupSignalHandlers()
                                      false); // Run before default handler
     signal_window_state_event().connect(sigc::mem_fun(*this, &AppWindow::onWindowStateEvent));
     m_commandManager.commandExecuted.connect(sigc::mem_fun(*this, &AppWindow::onCommandExecuted));
+
+    m_savingRevealer.cancelRequested.connect([this]() {
+        if (m_isSaveCanceled != nullptr)
+            *m_isSaveCanceled = true;
+    });
 }
 
 void AppWindow::loadCustomCSS()
@@ -273,30 +283,60 @@ void AppWindow::onShortcutsAction()
 
 void AppWindow::onSaveAction()
 {
-    showSaveFileDialogAndSave(SaveFileIn::Background);
+    if (m_isEstimatingSave)
+        return;
+
+    // The dialog can't take the estimates once it's shown, so it waits
+    // for them. The window can't close before, see on_delete_event().
+    m_isEstimatingSave = true;
+    m_saveAction->set_enabled(false);
+
+    Future<std::vector<PdfSaver::SaveEstimate>> estimates = m_taskRunner.runIo([saveData = m_document->getSaveData()]() {
+        return estimateSaves(saveData);
+    });
+
+    estimates.then(TaskRunner::mainLoop(), [this](const std::vector<PdfSaver::SaveEstimate>& result) {
+        m_isEstimatingSave = false;
+        m_saveAction->set_enabled(true);
+        showSaveFileDialogAndSave(SaveFileIn::Background, result);
+    });
+
+    estimates.onFailure(TaskRunner::mainLoop(), [this](const std::exception_ptr&) {
+        m_isEstimatingSave = false;
+        m_saveAction->set_enabled(true);
+
+        // The save itself will report what's wrong with the inputs
+        Logger::logError("The save could not be estimated");
+        showSaveFileDialogAndSave(SaveFileIn::Background, {});
+    });
 }
 
-bool AppWindow::showSaveFileDialogAndSave(SaveFileIn howToSave)
+bool AppWindow::showSaveFileDialogAndSave(SaveFileIn howToSave,
+                                          const std::vector<PdfSaver::SaveEstimate>& estimates)
 {
-    Slicer::SaveFileDialog dialog{*this, m_document->lastAddedFileParentPath()};
+    Slicer::SaveFileDialog dialog{*this, estimates, m_document->lastAddedFileParentPath()};
+
     const int result = dialog.run();
 
     if (result == GTK_RESPONSE_ACCEPT) {
         const Glib::RefPtr<Gio::File>& file = dialog.get_file();
+        PdfSaver::SaveOptions options = dialog.saveOptions();
+        options.sync = PdfSaver::SyncPolicy::FileAndDirectory;
 
         if (howToSave == SaveFileIn::Foreground)
-            return saveFileInForeground(file);
+            return saveFileInForeground(file, options);
         else //NOLINT
-            saveFileInBackground(file);
+            saveFileInBackground(file, options);
     }
 
     return false;
 }
 
-bool AppWindow::saveFileInForeground(const Glib::RefPtr<Gio::File>& file)
+bool AppWindow::saveFileInForeground(const Glib::RefPtr<Gio::File>& file,
+                                     const PdfSaver::SaveOptions& options)
 {
     try {
-        PdfSaver{m_document->getSaveData()}.save(file);
+        logSaveReport(PdfSaver{m_document->getSaveData()}.save(file, options));
 
         return true;
     }
@@ -310,27 +350,82 @@ bool AppWindow::saveFileInForeground(const Glib::RefPtr<Gio::File>& file)
     }
 }
 
-void AppWindow::saveFileInBackground(const Glib::RefPtr<Gio::File>& file)
+void AppWindow::saveFileInBackground(const Glib::RefPtr<Gio::File>& file,
+                                     const PdfSaver::SaveOptions& options)
 {
     m_savingRevealer.saving();
     m_saveAction->set_enabled(false);
     m_isSavingDocument = true;
+    m_isSaveCanceled = std::make_shared<std::atomic<bool>>(false);
+
+    PdfSaver::SaveOptions backgroundOptions = options;
+
+    backgroundOptions.isCanceled = [isCanceled = m_isSaveCanceled]() {
+        return isCanceled->load();
+    };
+
+    backgroundOptions.onProgress = [this](const PdfSaver::SaveProgress& progress) {
+        TaskRunner::mainLoop()([this, progress]() {
+            if (m_isSavingDocument)
+                m_savingRevealer.setProgress(progress.percentage, progress.bytesWritten);
+        });
+    };
+
+    Future<PdfSaver::SaveReport> saved = m_taskRunner.runIo([saveData = m_document->getSaveData(), file, backgroundOptions]() {
+        return PdfSaver{saveData}.save(file, backgroundOptions);
+    });
+
+    saved.then(TaskRunner::mainLoop(), [this](const PdfSaver::SaveReport& report) {
+        logSaveReport(report);
+        m_isSavingDocument = false;
+        m_savingRevealer.saved();
+        m_saveAction->set_enabled(true);
+        setModified(false);
+
+        // The save consumed the pre-parsed destination, so get the next one ready
+        warmUpSaveSession();
+    });
+
+    saved.onFailure(TaskRunner::mainLoop(), [this, file](const std::exception_ptr& exception) {
+        m_isSavingDocument = false;
+        m_savingRevealer.set_reveal_child(false);
+        m_saveAction->set_enabled(true);
+        warmUpSaveSession();
 
-    std::thread thread{[this, file]() {
         try {
-            PdfSaver{m_document->getSaveData()}.save(file);
-            m_savedDispatcher.emit();
+            std::rethrow_exception(exception);
+        }
+        catch (const TaskCanceled&) {
+            return;
         }
         catch (...) {
             Logger::logError("Saving the document failed");
             Logger::logError("The destination file was: " + file->get_path());
-            m_savingFailedDispatcher.emit();
+
+            showSaveFileFailedErrorDialog();
         }
+    });
+}
 
-        m_isSavingDocument = false;
-    }};
+void AppWindow::logSaveReport(const PdfSaver::SaveReport& report)
+{
+    if (report.deduplicatedStreams != 0)
+        Logger::logInfo("Merged " + std::to_string(report.deduplicatedStreams)
+                        + " duplicated streams, saving " + std::to_string(report.bytesSaved) + " bytes");
 
-    thread.detach();
+    if (report.downsampledImages != 0)
+        Logger::logInfo("Downsampled " + std::to_string(report.downsampledImages)
+                        + " images, saving " + std::to_string(report.imageBytesSaved) + " bytes");
+}
+
+void AppWindow::warmUpSaveSession()
+{
+    // Parsing ahead of time keeps the next save from paying for it.
+    // It's speculative, so it only gets the CPU and the disk nobody
+    // else wants, and never delays a save or a load.
+    (void) m_taskRunner.run([saveData = m_document->getSaveData()]() { PdfSaver{saveData}.warmUp(); },
+                            TaskRunner::defaultClient,
+                            TaskRunner::Priority::Idle);
 }
 
 void AppWindow::onOpenAction()
@@ -384,22 +479,50 @@ void AppWindow::setModified(bool modified)
 void AppWindow::tryAddDocumentsAt(const std::vector<Glib::RefPtr<Gio::File>>& files,
                                   unsigned int position)
 {
-    try {
+    // Pages show up file by file while the rest are still loading.
+    // Nothing can be edited meanwhile, as the positions the files
+    // are spliced at must stay the same. The window can't be closed
+    // either, see on_delete_event().
+    set_sensitive(false);
+    m_isAddingFiles = true;
+
+    Future<unsigned int> added = m_document->addFiles(files, position, TaskRunner::mainLoop());
+
+    added.then(TaskRunner::mainLoop(), [this, files, position](unsigned int numberOfAddedPages) {
+        set_sensitive(true);
+        m_isAddingFiles = false;
+
         auto command = std::make_shared<GuiAddFilesCommand>(*m_document,
                                                             files,
                                                             position,
+                                                            numberOfAddedPages,
                                                             m_headerBar,
                                                             m_view);
         m_commandManager.execute(command);
-    }
-    catch (...) {
+        warmUpSaveSession();
+    });
+
+    added.onFailure(TaskRunner::mainLoop(), [this, files](const std::exception_ptr& exception) {
+        set_sensitive(true);
+        m_isAddingFiles = false;
+
+        // The document was replaced while the files were loading
+        try {
+            std::rethrow_exception(exception);
+        }
+        catch (const TaskCanceled&) {
+            return;
+        }
+        catch (...) {
+        }
+
         Logger::logError("The files couldn't be added");
 
         for (const auto& file : files)
             Logger::logError("Filepath: " + file->get_path());
 
         showOpenFileFailedErrorDialog();
-    }
+    });
 }
 
 void AppWindow::onAddDocumentAtBeginningAction()
@@ -655,6 +778,17 @@ void AppWindow::onSelectedPagesChanged()
 
 void AppWindow::onCommandExecuted()
 {
+    // The history may have just forgotten the last pages of a file
+    m_document->releaseUnusedFiles();
+
+    // Only changes are logged, as most commands keep nothing alive
+    const std::size_t historyCost = m_commandManager.historyCost();
+
+    if (historyCost != m_loggedHistoryCost) {
+        m_loggedHistoryCost = historyCost;
+        Logger::logInfo("The undo history keeps about " + std::to_string(historyCost) + " bytes of pages alive");
+    }
+
     if (m_commandManager.canUndo()) {
         m_undoAction->set_enabled();
         setModified(true);
@@ -66,6 +66,10 @@ private:
     std::unique_ptr<Document> m_document;
     bool m_isDocumentModified = false;
     std::atomic<bool> m_isSavingDocument{false};
+    bool m_isAddingFiles = false;
+    bool m_isEstimatingSave = false;
+    std::size_t m_loggedHistoryCost = 0;
+    std::shared_ptr<std::atomic<bool>> m_isSaveCanceled;
     TaskRunner& m_taskRunner;
 
     SettingsManager& m_settingsManager;
@@ -85,8 +89,6 @@ private:
     ActionBar m_actionBar;
 
     SavingRevealer m_savingRevealer;
-    Glib::Dispatcher m_savedDispatcher;
-    Glib::Dispatcher m_savingFailedDispatcher;
 
     std::unique_ptr<Gtk::ShortcutsWindow> m_shortcutsWindow;
 
@@ -122,9 +124,14 @@ private:
     void addActions();
     void setupWidgets();
     void setupSignalHandlers();
-    bool showSaveFileDialogAndSave(SaveFileIn howToSave);
-    bool saveFileInForeground(const Glib::RefPtr<Gio::File>& file);
-    void saveFileInBackground(const Glib::RefPtr<Gio::File>& file);
+    bool showSaveFileDialogAndSave(SaveFileIn howToSave,
+                                   const std::vector<PdfSaver::SaveEstimate>& estimates);
+    bool saveFileInForeground(const Glib::RefPtr<Gio::File>& file,
+                              const PdfSaver::SaveOptions& options);
+    void saveFileInBackground(const Glib::RefPtr<Gio::File>& file,
+                              const PdfSaver::SaveOptions& options);
+    void warmUpSaveSession();
+    static void logSaveReport(const PdfSaver::SaveReport& report);
     void tryOpenDocument(const Glib::RefPtr<Gio::File>& file);
     void tryAddDocumentsAt(const std::vector<Glib::RefPtr<Gio::File>>& files,
                            unsigned int position);
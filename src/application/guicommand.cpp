@@ -27,9 +27,10 @@ namespace Slicer {
 GuiAddFilesCommand::GuiAddFilesCommand(Document& document,
                                        const std::vector<Glib::RefPtr<Gio::File>>& files,
                                        unsigned int position,
+                                       unsigned int numberOfAddedPages,
                                        HeaderBar& headerBar,
                                        View& view)
-    : AddFilesCommand{document, files, position}
+    : AddFilesCommand{document, files, position, numberOfAddedPages}
     , m_headerBar{headerBar}
     , m_view{view}
     , m_oldSubtitle{headerBar.get_subtitle()}
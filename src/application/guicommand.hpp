@@ -25,9 +25,11 @@ namespace Slicer {
 
 class GuiAddFilesCommand : public AddFilesCommand {
 public:
+    // The files are already added, see Document::addFiles()
     GuiAddFilesCommand(Document& document,
                        const std::vector<Glib::RefPtr<Gio::File>>& files,
                        unsigned int position,
+                       unsigned int numberOfAddedPages,
                        HeaderBar& headerBar,
                        View& view);
 
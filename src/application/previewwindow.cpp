@@ -25,9 +25,13 @@ namespace Slicer {
 
 const std::vector<int> PreviewWindow::zoomLevels = {1000, 1400, 1800, 2200, 2600};
 
+// A preview only ever has one render in flight, and the user is staring at it
+static const unsigned int previewClientWeight = 4;
+
 PreviewWindow::PreviewWindow(const Glib::RefPtr<const Page>& page, TaskRunner& taskRunner)
     : m_page{page}
     , m_taskRunner{taskRunner}
+    , m_taskClient{m_taskRunner.registerClient(previewClientWeight)}
     , m_actionGroup{Gio::SimpleActionGroup::create()}
     , m_zoomLevel{zoomLevels, *(m_actionGroup.operator->())}
 {
@@ -50,6 +54,7 @@ PreviewWindow::PreviewWindow(const Glib::RefPtr<const Page>& page, TaskRunner& t
 PreviewWindow::~PreviewWindow()
 {
     m_pageWidget->cancelRendering();
+    m_taskRunner.unregisterClient(m_taskClient);
 }
 
 void PreviewWindow::setTitle()
@@ -121,7 +126,7 @@ void PreviewWindow::renderPage()
     auto task = std::make_shared<RenderTask<PageWidget>>(m_pageWidget,
                                                          m_zoomLevel.currentLevel());
     m_pageWidget->setRenderingTask(std::static_pointer_cast<Task>(task));
-    m_taskRunner.queueFront(std::static_pointer_cast<Task>(task));
+    m_taskRunner.queueFront(std::static_pointer_cast<Task>(task), m_taskClient);
 }
 
 } // namespace Slicer
@@ -51,6 +51,7 @@ private:
 
     Glib::RefPtr<const Page> m_page;
     TaskRunner& m_taskRunner;
+    TaskRunner::ClientId m_taskClient;
 	Glib::RefPtr<Gio::SimpleActionGroup> m_actionGroup;
 	ZoomLevelWithActions m_zoomLevel;
     static const std::vector<int> zoomLevels;
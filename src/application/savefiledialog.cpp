@@ -20,7 +20,89 @@
 
 namespace Slicer {
 
+namespace save_profile {
+    static const Glib::ustring choiceId = "save-profile";
+
+    static const struct {
+        Glib::ustring fast = "fast";
+        Glib::ustring balanced = "balanced";
+        Glib::ustring compact = "compact";
+    } options;
+}
+
+static const Glib::ustring linearizeChoiceId = "linearize";
+static const Glib::ustring incrementalChoiceId = "incremental";
+static const Glib::ustring downsampleChoiceId = "downsample-images";
+
+// Plenty for reading and printing archive copies of scanned documents
+static const int downsampledImageResolution = 150;
+
+static PdfSaver::SaveOptions optionsForProfile(const Glib::ustring& profile)
+{
+    PdfSaver::SaveOptions result;
+
+    if (profile == save_profile::options.fast) {
+        result.profile = PdfSaver::SaveProfile::Fast;
+    }
+    else if (profile == save_profile::options.compact) {
+        result.profile = PdfSaver::SaveProfile::Compact;
+    }
+
+    return result;
+}
+
+static std::vector<Glib::ustring> profiles()
+{
+    return {save_profile::options.fast,
+            save_profile::options.balanced,
+            save_profile::options.compact};
+}
+
+static std::vector<Glib::ustring> profileLabels()
+{
+    return {_("Fast"), _("Balanced"), _("Smallest file")};
+}
+
+static Glib::ustring describeDuration(std::chrono::milliseconds duration)
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+
+    if (seconds < 1)
+        return _("under a second");
+
+    if (seconds < 60)
+        return Glib::ustring::compose(_("%1 s"), seconds);
+
+    return Glib::ustring::compose(_("%1 min"), (seconds + 59) / 60);
+}
+
+static Glib::ustring describeEstimate(const Glib::ustring& label,
+                                      const PdfSaver::SaveEstimate& estimate)
+{
+    gchar* size = g_format_size(estimate.bytes);
+    const Glib::ustring result = Glib::ustring::compose(_("%1 (about %2, %3)"),
+                                                        label,
+                                                        size,
+                                                        describeDuration(estimate.duration));
+    g_free(size);
+
+    return result;
+}
+
+static std::vector<Glib::ustring> labelsWithEstimates(const std::vector<PdfSaver::SaveEstimate>& estimates)
+{
+    std::vector<Glib::ustring> result = profileLabels();
+
+    if (estimates.size() == result.size()) {
+        for (std::size_t i = 0; i < result.size(); ++i)
+            result.at(i) = describeEstimate(result.at(i), estimates.at(i));
+    }
+
+    return result;
+}
+
 SaveFileDialog::SaveFileDialog(Gtk::Window& parent,
+                               const std::vector<PdfSaver::SaveEstimate>& estimates,
                                std::optional<std::string> folderPath)
     : Gtk::FileChooserNative{_("Save document as"),
                              parent,
@@ -32,8 +114,42 @@ SaveFileDialog::SaveFileDialog(Gtk::Window& parent,
     add_filter(pdfFilter());
     set_do_overwrite_confirmation(true);
 
+    add_choice(save_profile::choiceId, _("Output"), profiles(), labelsWithEstimates(estimates));
+    add_choice(linearizeChoiceId, _("Optimize for web view"));
+    add_choice(downsampleChoiceId, _("Reduce image resolution"));
+
+    // Saves that remove pages are always written in full
+    add_choice(incrementalChoiceId, _("Only append the new page order to the original file"));
+
+    set_choice(save_profile::choiceId, save_profile::options.balanced);
+    set_choice(linearizeChoiceId, "false");
+    set_choice(downsampleChoiceId, "false");
+    set_choice(incrementalChoiceId, "false");
+
     if (folderPath.has_value())
         set_current_folder(folderPath.value());
 }
 
+std::vector<PdfSaver::SaveOptions> SaveFileDialog::estimatedOptions()
+{
+    std::vector<PdfSaver::SaveOptions> result;
+
+    for (const Glib::ustring& profile : profiles())
+        result.push_back(optionsForProfile(profile));
+
+    return result;
+}
+
+PdfSaver::SaveOptions SaveFileDialog::saveOptions() const
+{
+    PdfSaver::SaveOptions result = optionsForProfile(get_choice(save_profile::choiceId));
+    result.linearize = get_choice(linearizeChoiceId) == "true";
+    result.incremental = get_choice(incrementalChoiceId) == "true";
+
+    if (get_choice(downsampleChoiceId) == "true")
+        result.imageResolution = downsampledImageResolution;
+
+    return result;
+}
+
 } // namespace Slicer
@@ -19,13 +19,26 @@
 
 #include <gtkmm/filechoosernative.h>
 #include <optional>
+#include <pdfsaver.hpp>
+#include <vector>
 
 namespace Slicer {
 
 class SaveFileDialog : public Gtk::FileChooserNative {
 public:
+    // Every profile is labeled with its estimate. Native and portal
+    // dialogs ignore the choices changed once they're shown, so the
+    // estimates have to be ready before. Without them, the profiles
+    // get their plain labels.
     SaveFileDialog(Gtk::Window& parent,
+                   const std::vector<PdfSaver::SaveEstimate>& estimates,
                    std::optional<std::string> folderPath = {});
+
+    PdfSaver::SaveOptions saveOptions() const;
+
+    // The options of every save profile, in the order
+    // the constructor takes their estimates
+    static std::vector<PdfSaver::SaveOptions> estimatedOptions();
 };
 
 } // namespace Slicer
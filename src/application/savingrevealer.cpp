@@ -26,8 +26,16 @@ SavingRevealer::SavingRevealer()
     m_labelSaving.set_padding(10, -1);
     m_spinner.set_size_request(22, 22);
     m_spinner.set_margin_right(3);
+    m_progressBar.set_show_text(true);
+    m_progressBar.set_valign(Gtk::ALIGN_CENTER);
+    m_progressBar.set_margin_right(3);
+    m_cancelButton.set_image_from_icon_name("process-stop-symbolic");
+    m_cancelButton.set_tooltip_text(_("Cancel saving"));
+    m_cancelButton.get_style_context()->add_class("flat");
     m_boxSaving.pack_start(m_labelSaving);
     m_boxSaving.pack_start(m_spinner);
+    m_boxSaving.pack_start(m_progressBar);
+    m_boxSaving.pack_start(m_cancelButton);
 
     m_labelDone.set_label(_("Document succesfully saved"));
     m_labelDone.set_padding(10, -1);
@@ -45,6 +53,11 @@ SavingRevealer::SavingRevealer()
     m_closeButton.signal_clicked().connect([this]() {
         set_reveal_child(false);
     });
+
+    m_cancelButton.signal_clicked().connect([this]() {
+        m_cancelButton.set_sensitive(false);
+        cancelRequested.emit();
+    });
 }
 
 void SavingRevealer::saving()
@@ -53,6 +66,9 @@ void SavingRevealer::saving()
     m_outerFrame.add(m_boxSaving);
     m_boxSaving.show_all();
     m_spinner.start();
+    m_progressBar.set_fraction(0);
+    m_progressBar.set_text("");
+    m_cancelButton.set_sensitive(true);
 
     // Prevent any previous previous saving operation started
     // from hiding the popup prematurely
@@ -62,6 +78,16 @@ void SavingRevealer::saving()
     set_reveal_child(true);
 }
 
+void SavingRevealer::setProgress(int percentage, std::size_t bytesWritten)
+{
+    gchar* size = g_format_size(bytesWritten);
+
+    m_progressBar.set_fraction(percentage / 100.0);
+    m_progressBar.set_text(size);
+
+    g_free(size);
+}
+
 void SavingRevealer::saved()
 {
     m_outerFrame.remove();
@@ -21,6 +21,7 @@
 #include <gtkmm/button.h>
 #include <gtkmm/frame.h>
 #include <gtkmm/label.h>
+#include <gtkmm/progressbar.h>
 #include <gtkmm/revealer.h>
 #include <gtkmm/spinner.h>
 
@@ -31,14 +32,19 @@ public:
     SavingRevealer();
 
     void saving();
+    void setProgress(int percentage, std::size_t bytesWritten);
     void saved();
 
+    sigc::signal<void> cancelRequested;
+
 private:
     Gtk::Frame m_outerFrame;
 
     Gtk::Box m_boxSaving;
     Gtk::Label m_labelSaving;
     Gtk::Spinner m_spinner;
+    Gtk::ProgressBar m_progressBar;
+    Gtk::Button m_cancelButton;
 
     Gtk::Box m_boxDone;
     Gtk::Label m_labelDone;
@@ -25,7 +25,8 @@ bool Task::isCanceled() const
 
 void Task::cancel()
 {
-    m_isCanceled = true;
+    if (!m_isCanceled.exchange(true))
+        onCanceled();
 }
 
 } // namespace Slicer
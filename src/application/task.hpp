@@ -18,6 +18,7 @@
 #define SLICER_TASK_HPP
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include "pagerenderer.hpp"
 
@@ -25,6 +26,8 @@ namespace Slicer {
 
 class Task {
 public:
+    Task() = default;
+
     Task(const Task&) = delete;
     Task& operator=(const Task&) = delete;
     Task(Task&&) = delete;
@@ -38,10 +41,42 @@ public:
 
     virtual ~Task() = default;
 
+protected:
+    // Called by the first call to cancel()
+    virtual void onCanceled() {}
+
 private:
 	std::atomic_bool m_isCanceled = false;
 };
 
+// Wraps a plain function, so callers don't need a Task subclass
+// for every background operation. See TaskRunner::run().
+class FunctionTask : public Task {
+public:
+    FunctionTask(std::function<void()> function,
+                 std::function<void()> onCanceled = {})
+        : m_function{std::move(function)}
+        , m_onCanceled{std::move(onCanceled)}
+    {
+    }
+
+    void execute() override
+    {
+        m_function();
+    }
+
+protected:
+    void onCanceled() override
+    {
+        if (m_onCanceled)
+            m_onCanceled();
+    }
+
+private:
+    std::function<void()> m_function;
+    std::function<void()> m_onCanceled;
+};
+
 template <typename T>
 class RenderTask : public Task {
 public:
@@ -15,41 +15,220 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "taskrunner.hpp"
+#include <algorithm>
 #include <glibmm/main.h>
 #include <gsl/gsl>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+// Keeps the min and max macros of windows.h from breaking std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
 
 namespace Slicer {
 
 TaskRunner::TaskRunner()
     : m_threadpool{numberOfThreads()}
+    , m_idleThreadpool{numberOfIdleThreads()}
 {
+    m_clientQueues[defaultClient] = ClientQueue{{}, strideBase, {}};
 }
 
 TaskRunner::~TaskRunner()
 {
     m_threadpool.wait();
+    m_idleThreadpool.wait();
+    IoExecutor::instance().waitUntilAllTasksFinish();
 }
 
-void TaskRunner::queueBack(const std::shared_ptr<Task>& task)
+TaskRunner::ClientId TaskRunner::registerClient(unsigned int weight)
 {
-    m_threadpool.push([task]() {
-        runTask(task);
-    });
+    if (weight == 0)
+        throw std::runtime_error("A client needs a weight greater than zero");
+
+    std::lock_guard<std::mutex> lock{m_queuesMutex};
+
+    const ClientId client = m_nextClientId++;
+    m_clientQueues[client] = ClientQueue{{}, strideBase / weight, m_virtualTime};
+
+    return client;
+}
+
+void TaskRunner::unregisterClient(ClientId client)
+{
+    if (client == defaultClient)
+        return;
+
+    std::vector<std::shared_ptr<Task>> pendingTasks;
+
+    {
+        std::lock_guard<std::mutex> lock{m_queuesMutex};
+
+        auto it = m_clientQueues.find(client);
+
+        if (it == m_clientQueues.end())
+            return;
+
+        for (auto& tasks : it->second.tasks)
+            pendingTasks.insert(pendingTasks.end(), tasks.begin(), tasks.end());
+
+        // The tokens already pushed to the pool will just find nothing to do
+        m_clientQueues.erase(it);
+    }
+
+    // Canceling may run continuations, so it's done outside of the lock
+    for (const std::shared_ptr<Task>& task : pendingTasks)
+        task->cancel();
+}
+
+void TaskRunner::queueBack(const std::shared_ptr<Task>& task,
+                           ClientId client,
+                           Priority priority)
+{
+    enqueue(task, client, priority, false);
+}
+
+void TaskRunner::queueFront(const std::shared_ptr<Task>& task,
+                            ClientId client,
+                            Priority priority)
+{
+    enqueue(task, client, priority, true);
+}
+
+Scheduler TaskRunner::worker(ClientId client, Priority priority)
+{
+    return [this, client, priority](std::function<void()> function) {
+        queueBack(std::make_shared<FunctionTask>(std::move(function)), client, priority);
+    };
+}
+
+Scheduler TaskRunner::io()
+{
+    return [](std::function<void()> function) {
+        (void) IoExecutor::instance().submit(std::move(function));
+    };
 }
 
-void TaskRunner::queueFront(const std::shared_ptr<Task>& task)
+Scheduler TaskRunner::mainLoop()
 {
-    std::thread{[this, task]() {
-        m_threadpool.apply_for(1, [task]() {
-            runTask(task);
+    return [](std::function<void()> function) {
+        Glib::signal_idle().connect_once([function]() {
+            function();
         });
-    }}
-        .detach();
+    };
 }
 
 void TaskRunner::waitUntilAllTasksFinish()
 {
-    m_threadpool.wait();
+    waitUntilTasksFinish(Priority::Interactive);
+    waitUntilTasksFinish(Priority::Idle);
+}
+
+void TaskRunner::waitUntilTasksFinish(Priority priority)
+{
+    if (priority == Priority::Idle)
+        m_idleThreadpool.wait();
+    else
+        m_threadpool.wait();
+}
+
+void TaskRunner::enqueue(const std::shared_ptr<Task>& task,
+                         ClientId client,
+                         Priority priority,
+                         bool atFront)
+{
+    const auto lane = static_cast<std::size_t>(priority);
+    bool isQueued = false;
+
+    {
+        std::lock_guard<std::mutex> lock{m_queuesMutex};
+
+        if (auto it = m_clientQueues.find(client); it != m_clientQueues.end()) {
+            ClientQueue& queue = it->second;
+
+            // A client that was idle doesn't get to bank credit for that time
+            if (queue.tasks.at(lane).empty())
+                queue.pass.at(lane) = std::max(queue.pass.at(lane), m_virtualTime.at(lane));
+
+            if (atFront)
+                queue.tasks.at(lane).push_front(task);
+            else
+                queue.tasks.at(lane).push_back(task);
+
+            isQueued = true;
+        }
+    }
+
+    // The client is already gone, e.g. a continuation of a closed window
+    if (!isQueued) {
+        task->cancel();
+        return;
+    }
+
+    // The pool only sees anonymous tokens. Which task a token runs is
+    // decided when a worker picks it up, by the fair scheduler below.
+    if (priority == Priority::Idle) {
+        m_idleThreadpool.push([this]() {
+            lowerCurrentThreadPriority();
+            runNextTask(Priority::Idle);
+        });
+    }
+    else {
+        m_threadpool.push([this]() {
+            runNextTask(Priority::Interactive);
+        });
+    }
+}
+
+std::shared_ptr<Task> TaskRunner::dequeueNextTask(Priority priority)
+{
+    const auto lane = static_cast<std::size_t>(priority);
+
+    std::lock_guard<std::mutex> lock{m_queuesMutex};
+
+    // Stride scheduling: serve the non-empty client with the lowest pass,
+    // then advance its pass inversely to its weight
+    ClientQueue* nextQueue = nullptr;
+
+    for (auto& entry : m_clientQueues) {
+        ClientQueue& queue = entry.second;
+        std::deque<std::shared_ptr<Task>>& tasks = queue.tasks.at(lane);
+
+        while (!tasks.empty() && tasks.front()->isCanceled())
+            tasks.pop_front();
+
+        if (tasks.empty())
+            continue;
+
+        if (nextQueue == nullptr || queue.pass.at(lane) < nextQueue->pass.at(lane))
+            nextQueue = &queue;
+    }
+
+    if (nextQueue == nullptr)
+        return nullptr;
+
+    std::shared_ptr<Task> task = nextQueue->tasks.at(lane).front();
+    nextQueue->tasks.at(lane).pop_front();
+
+    m_virtualTime.at(lane) = nextQueue->pass.at(lane);
+    nextQueue->pass.at(lane) += nextQueue->stride;
+
+    return task;
+}
+
+void TaskRunner::runNextTask(Priority priority)
+{
+    if (std::shared_ptr<Task> task = dequeueNextTask(priority); task != nullptr)
+        runTask(task);
 }
 
 void TaskRunner::runTask(const std::shared_ptr<Task>& task)
@@ -68,6 +247,37 @@ void TaskRunner::runTask(const std::shared_ptr<Task>& task)
     });
 }
 
+void TaskRunner::lowerCurrentThreadPriority()
+{
+    // Threads of the idle pool never run anything else,
+    // so they only need to be demoted once
+    static thread_local bool isDemoted = false;
+
+    if (isDemoted)
+        return;
+
+    isDemoted = true;
+
+#ifdef __linux__
+    sched_param parameters{};
+    parameters.sched_priority = 0;
+
+    // SCHED_IDLE may be forbidden (e.g. inside some sandboxes).
+    // The highest niceness is the next best thing.
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters) != 0)
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    // Idle tasks read files too (e.g. warming up a save), so their disk
+    // requests also wait for everyone else's. glibc has no wrapper for it.
+    const int ioprioWhoProcess = 1;
+    const int ioprioClassIdle = 3;
+    const int ioprioClassShift = 13;
+    syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprioClassIdle << ioprioClassShift);
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#endif
+}
+
 int TaskRunner::numberOfThreads()
 {
     const unsigned int numberOfCores = std::thread::hardware_concurrency();
@@ -79,4 +289,11 @@ int TaskRunner::numberOfThreads()
     return 1;
 }
 
+int TaskRunner::numberOfIdleThreads()
+{
+    // Idle work is speculative, so a few threads are enough
+    // to keep it going without crowding the interactive ones
+    return std::max(1, numberOfThreads() / 2);
+}
+
 } // namespace Slicer
@@ -18,12 +18,28 @@
 #define SLICER_TASKRUNNER_HPP
 
 #include "task.hpp"
+#include <future.hpp>
+#include <ioexecutor.hpp>
 #include <threadpool.hpp>
+#include <array>
+#include <deque>
+#include <map>
+#include <mutex>
 
 namespace Slicer {
 
 class TaskRunner {
 public:
+    using ClientId = unsigned int;
+
+    // Interactive tasks run on normal priority threads.
+    // Idle tasks (speculative or warm-up work) run on threads the OS only
+    // schedules when nothing else wants the CPU or, on Linux, the disk.
+    enum class Priority {
+        Interactive,
+        Idle
+    };
+
 	TaskRunner();
 
     TaskRunner(const TaskRunner&) = delete;
@@ -33,17 +49,114 @@ public:
 
 	~TaskRunner();
 
-	void queueBack(const std::shared_ptr<Task>& task);
-	void queueFront(const std::shared_ptr<Task>& task);
+    // Every window (and every preview) registers itself as a client.
+    // Clients are served in proportion to their weight, so a client that
+    // queues thousands of tasks can't starve the others.
+    // Unregistering cancels the pending tasks of the client, and so does
+    // queueing a task for a client that isn't registered.
+    ClientId registerClient(unsigned int weight = 1);
+    void unregisterClient(ClientId client);
+
+	void queueBack(const std::shared_ptr<Task>& task,
+                   ClientId client = defaultClient,
+                   Priority priority = Priority::Interactive);
+	void queueFront(const std::shared_ptr<Task>& task,
+                    ClientId client = defaultClient,
+                    Priority priority = Priority::Interactive);
+
+    // Waits for the worker tasks only. Background I/O (saves, loads)
+    // may take much longer, and doesn't hold on to what the workers use.
     void waitUntilAllTasksFinish();
+    void waitUntilTasksFinish(Priority priority);
+
+    // Typed counterparts of the queue functions.
+    // Canceling the returned future drops the task if it didn't start yet.
+    template <typename F>
+    Future<std::invoke_result_t<F>> run(F function,
+                                        ClientId client = defaultClient,
+                                        Priority priority = Priority::Interactive);
+    template <typename F>
+    Future<std::invoke_result_t<F>> runIo(F function);
+
+    // Schedulers for Future::then()
+    Scheduler worker(ClientId client = defaultClient,
+                     Priority priority = Priority::Interactive);
+    static Scheduler io();
+    static Scheduler mainLoop();
+
+    static constexpr ClientId defaultClient = 0;
 
 private:
+    static constexpr std::size_t numberOfPriorities = 2;
+
+    struct ClientQueue {
+        std::array<std::deque<std::shared_ptr<Task>>, numberOfPriorities> tasks;
+        unsigned long stride;
+        std::array<unsigned long, numberOfPriorities> pass;
+    };
+
+    static constexpr unsigned long strideBase = 1UL << 16;
+
+    std::mutex m_queuesMutex;
+    std::map<ClientId, ClientQueue> m_clientQueues;
+    ClientId m_nextClientId = defaultClient + 1;
+    std::array<unsigned long, numberOfPriorities> m_virtualTime{};
+
+    void enqueue(const std::shared_ptr<Task>& task,
+                 ClientId client,
+                 Priority priority,
+                 bool atFront);
+    std::shared_ptr<Task> dequeueNextTask(Priority priority);
+    void runNextTask(Priority priority);
+
     static void runTask(const std::shared_ptr<Task>& task);
+    static void lowerCurrentThreadPriority();
     static int numberOfThreads();
+    static int numberOfIdleThreads();
 
 	astp::ThreadPool m_threadpool;
+    astp::ThreadPool m_idleThreadpool;
 };
 
+template <typename F>
+Future<std::invoke_result_t<F>> TaskRunner::run(F function,
+                                                ClientId client,
+                                                Priority priority)
+{
+    Promise<std::invoke_result_t<F>> promise;
+
+    // A task the runner drops without running it is canceled,
+    // which resolves the future with TaskCanceled
+    auto task = std::make_shared<FunctionTask>(
+        [promise, function]() mutable {
+            promise.fulfil(function);
+        },
+        [promise]() {
+            promise.cancel();
+        });
+
+    promise.future().onCancel([weakTask = std::weak_ptr<Task>{task}]() {
+        if (auto canceledTask = weakTask.lock(); canceledTask != nullptr)
+            canceledTask->cancel();
+    });
+
+    queueBack(task, client, priority);
+
+    return promise.future();
+}
+
+template <typename F>
+Future<std::invoke_result_t<F>> TaskRunner::runIo(F function)
+{
+    Promise<std::invoke_result_t<F>> promise;
+
+    io()([promise, function]() mutable {
+        promise.fulfil(function);
+    });
+
+    return promise.future();
+}
+
 } // namespace Slicer
 
 #endif // SLICER_TASKRUNNER_HPP
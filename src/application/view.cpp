@@ -28,6 +28,7 @@ View::View(TaskRunner& taskRunner,
            const std::function<void()>& onMouseWheelUp,
            const std::function<void()>& onMouseWheelDown)
     : m_taskRunner{taskRunner}
+    , m_taskClient{m_taskRunner.registerClient()}
 {
     setupFlowbox();
     setupSignalHandlers(onMouseWheelUp, onMouseWheelDown);
@@ -70,6 +71,7 @@ View::~View()
         connection.disconnect();
 
     cancelRenderingTasks();
+    m_taskRunner.unregisterClient(m_taskClient);
 }
 
 std::shared_ptr<InteractivePageWidget> View::createPageWidget(const Glib::RefPtr<const Page>& page)
@@ -259,7 +261,7 @@ void View::renderPage(const std::shared_ptr<InteractivePageWidget>& pageWidget)
 {
     auto task = std::make_shared<RenderTask<InteractivePageWidget>>(pageWidget, m_pageWidgetSize);
     pageWidget->setRenderingTask(std::static_pointer_cast<Task>(task));
-    m_taskRunner.queueBack(std::static_pointer_cast<Task>(task));
+    m_taskRunner.queueBack(std::static_pointer_cast<Task>(task), m_taskClient);
 }
 
 void View::cancelRenderingTasks()
@@ -66,6 +66,7 @@ private:
     Document* m_document = nullptr;
     std::vector<sigc::connection> m_documentConnections;
     TaskRunner& m_taskRunner;
+    TaskRunner::ClientId m_taskClient;
 
     InteractivePageWidget* m_lastPageSelected = nullptr;
 
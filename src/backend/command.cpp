@@ -15,9 +15,25 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "command.hpp"
+#include <algorithm>
+#include <numeric>
 
 namespace Slicer {
 
+// What a page pins: its poppler page, and its share of the parsed file
+static const std::size_t estimatedPageCost = 64 * 1024;
+
+// Commands that only hold page indexes cost next to nothing
+std::size_t Command::memoryCost() const
+{
+    return 0;
+}
+
+bool Command::mergeWith(const Command&)
+{
+    return false;
+}
+
 RemovePageCommand::RemovePageCommand(Document& document,
                                      unsigned int position)
     : m_document{document}
@@ -33,11 +49,18 @@ void RemovePageCommand::execute()
 void RemovePageCommand::undo()
 {
     m_document.insertPage(m_removedPage);
+    m_isUndone = true;
 }
 
 void RemovePageCommand::redo()
 {
     m_document.removePage(m_position);
+    m_isUndone = false;
+}
+
+std::size_t RemovePageCommand::memoryCost() const
+{
+    return m_removedPage && !m_isUndone ? estimatedPageCost : 0;
 }
 
 RemovePagesCommand::RemovePagesCommand(Document& document,
@@ -55,11 +78,18 @@ void RemovePagesCommand::execute()
 void RemovePagesCommand::undo()
 {
     m_document.insertPages(m_removedPages);
+    m_isUndone = true;
 }
 
 void RemovePagesCommand::redo()
 {
     m_document.removePages(m_listPositions);
+    m_isUndone = false;
+}
+
+std::size_t RemovePagesCommand::memoryCost() const
+{
+    return m_isUndone ? 0 : m_removedPages.size() * estimatedPageCost;
 }
 
 RemovePageRangeCommand::RemovePageRangeCommand(Document& document,
@@ -79,55 +109,71 @@ void RemovePageRangeCommand::execute()
 void RemovePageRangeCommand::undo()
 {
     m_document.insertPageRange(m_removedPages, m_first);
+    m_isUndone = true;
 }
 
 void RemovePageRangeCommand::redo()
 {
     m_document.removePageRange(m_first, m_last);
+    m_isUndone = false;
 }
 
-RotatePagesRightCommand::RotatePagesRightCommand(Document& document,
-                                                 const std::vector<unsigned int>& pageNumbers)
+std::size_t RemovePageRangeCommand::memoryCost() const
+{
+    return m_isUndone ? 0 : m_removedPages.size() * estimatedPageCost;
+}
+
+RotatePagesCommand::RotatePagesCommand(Document& document,
+                                       const std::vector<unsigned int>& pageNumbers,
+                                       int quarterTurns)
     : m_document{document}
     , m_pageNumbers{pageNumbers}
+    , m_quarterTurns{quarterTurns}
 {
 }
 
-void RotatePagesRightCommand::execute()
+// Rotations folded into a whole turn leave the document alone,
+// instead of notifying the view of pages that didn't change
+void RotatePagesCommand::execute()
 {
-    m_document.rotatePagesRight(m_pageNumbers);
+    if (m_quarterTurns != 0)
+        m_document.rotatePages(m_pageNumbers, m_quarterTurns);
 }
 
-void RotatePagesRightCommand::undo()
+void RotatePagesCommand::undo()
 {
-    m_document.rotatePagesLeft(m_pageNumbers);
+    if (m_quarterTurns != 0)
+        m_document.rotatePages(m_pageNumbers, -m_quarterTurns);
 }
 
-void RotatePagesRightCommand::redo()
+void RotatePagesCommand::redo()
 {
     execute();
 }
 
-RotatePagesLeftCommand::RotatePagesLeftCommand(Document& document,
-                                               const std::vector<unsigned int>& pageNumbers)
-    : m_document{document}
-    , m_pageNumbers{pageNumbers}
+// Rotations of the same pages add up, whatever their direction
+bool RotatePagesCommand::mergeWith(const Command& next)
 {
-}
+    const auto* rotation = dynamic_cast<const RotatePagesCommand*>(&next);
 
-void RotatePagesLeftCommand::execute()
-{
-    m_document.rotatePagesLeft(m_pageNumbers);
+    if (rotation == nullptr || rotation->m_pageNumbers != m_pageNumbers)
+        return false;
+
+    m_quarterTurns = (m_quarterTurns + rotation->m_quarterTurns) % 4;
+
+    return true;
 }
 
-void RotatePagesLeftCommand::undo()
+RotatePagesRightCommand::RotatePagesRightCommand(Document& document,
+                                                 const std::vector<unsigned int>& pageNumbers)
+    : RotatePagesCommand{document, pageNumbers, 1}
 {
-    m_document.rotatePagesRight(m_pageNumbers);
 }
 
-void RotatePagesLeftCommand::redo()
+RotatePagesLeftCommand::RotatePagesLeftCommand(Document& document,
+                                               const std::vector<unsigned int>& pageNumbers)
+    : RotatePagesCommand{document, pageNumbers, -1}
 {
-    execute();
 }
 
 MovePageCommand::MovePageCommand(Document& document,
@@ -154,6 +200,19 @@ void MovePageCommand::redo()
     execute();
 }
 
+// Moving the same page again only changes where it ends up
+bool MovePageCommand::mergeWith(const Command& next)
+{
+    const auto* move = dynamic_cast<const MovePageCommand*>(&next);
+
+    if (move == nullptr || move->m_indexToMove != m_indexDestination)
+        return false;
+
+    m_indexDestination = move->m_indexDestination;
+
+    return true;
+}
+
 MovePageRangeCommand::MovePageRangeCommand(Document& document,
                                            unsigned int indexFirst,
                                            unsigned int indexLast,
@@ -184,6 +243,19 @@ void MovePageRangeCommand::redo()
     execute();
 }
 
+bool MovePageRangeCommand::mergeWith(const Command& next)
+{
+    const auto* move = dynamic_cast<const MovePageRangeCommand*>(&next);
+
+    if (move == nullptr || move->m_indexFirst != m_indexDestination
+        || move->m_indexLast - move->m_indexFirst != m_indexLast - m_indexFirst)
+        return false;
+
+    m_indexDestination = move->m_indexDestination;
+
+    return true;
+}
+
 AddFilesCommand::AddFilesCommand(Document& document,
                                  const std::vector<Glib::RefPtr<Gio::File>>& files,
                                  unsigned int position)
@@ -193,19 +265,189 @@ AddFilesCommand::AddFilesCommand(Document& document,
 {
 }
 
+AddFilesCommand::AddFilesCommand(Document& document,
+                                 const std::vector<Glib::RefPtr<Gio::File>>& files,
+                                 unsigned int position,
+                                 unsigned int numberOfAddedPages)
+    : m_files{files}
+    , m_position{position}
+    , m_numberOfAddedPages{numberOfAddedPages}
+    , m_document{document}
+    , m_isAddedAhead{true}
+{
+}
+
 void AddFilesCommand::execute()
 {
-    m_numberOfAddedPages = m_document.addFiles(m_files, m_position);
+    if (!m_isAddedAhead)
+        m_numberOfAddedPages = m_document.addFiles(m_files, m_position);
 }
 
 void AddFilesCommand::undo()
 {
     m_addedPages = m_document.removePageRange(m_position, m_position + m_numberOfAddedPages - 1);
+    m_isUndone = true;
 }
 
 void AddFilesCommand::redo()
 {
     m_document.insertPageRange(m_addedPages, m_position);
+    m_isUndone = false;
+}
+
+std::size_t AddFilesCommand::memoryCost() const
+{
+    return m_isUndone ? m_addedPages.size() * estimatedPageCost : 0;
+}
+
+PermutePagesCommand::PermutePagesCommand(Document& document,
+                                         const std::vector<unsigned int>& order)
+    : m_document{document}
+    , m_order{order}
+{
+}
+
+void PermutePagesCommand::execute()
+{
+    m_document.permutePages(m_order);
+}
+
+// The order itself is enough to put the pages back
+void PermutePagesCommand::undo()
+{
+    m_document.restorePageOrder(m_order);
+}
+
+void PermutePagesCommand::redo()
+{
+    execute();
+}
+
+std::size_t PermutePagesCommand::memoryCost() const
+{
+    return m_order.size() * sizeof(unsigned int);
+}
+
+namespace PageOrder {
+    std::vector<unsigned int> reversed(unsigned int numberOfPages)
+    {
+        std::vector<unsigned int> result(numberOfPages);
+        std::iota(result.rbegin(), result.rend(), 0);
+
+        return result;
+    }
+
+    std::vector<unsigned int> interleaved(unsigned int numberOfPages, bool areBacksReversed)
+    {
+        const unsigned int numberOfFronts = (numberOfPages + 1) / 2;
+        std::vector<unsigned int> result;
+        result.reserve(numberOfPages);
+
+        for (unsigned int i = 0; i < numberOfFronts; ++i) {
+            result.push_back(i);
+
+            if (numberOfFronts + i < numberOfPages)
+                result.push_back(areBacksReversed ? numberOfPages - 1 - i : numberOfFronts + i);
+        }
+
+        return result;
+    }
+
+    std::vector<unsigned int> sortedBy(const Document& document,
+                                       const std::function<bool(const Page&, const Page&)>& isBefore)
+    {
+        std::vector<Glib::RefPtr<Page>> pages;
+
+        for (unsigned int i = 0; i < document.numberOfPages(); ++i)
+            pages.push_back(document.getPage(i));
+
+        std::vector<unsigned int> result(pages.size());
+        std::iota(result.begin(), result.end(), 0);
+        std::stable_sort(result.begin(), result.end(), [&pages, &isBefore](unsigned int a, unsigned int b) {
+            return isBefore(*pages.at(a), *pages.at(b));
+        });
+
+        return result;
+    }
+
+    std::vector<unsigned int> sortedBySourceFile(const Document& document)
+    {
+        return sortedBy(document, [](const Page& a, const Page& b) {
+            return std::make_pair(a.m_fileNumber, a.indexInFile())
+                   < std::make_pair(b.m_fileNumber, b.indexInFile());
+        });
+    }
+}
+
+CompositeCommand::CompositeCommand(Document& document)
+    : m_document{document}
+{
+}
+
+void CompositeCommand::add(const std::shared_ptr<Command>& command)
+{
+    m_commands.push_back(command);
+}
+
+bool CompositeCommand::isEmpty() const
+{
+    return m_commands.empty();
+}
+
+void CompositeCommand::execute()
+{
+    applyAll(m_commands.begin(), m_commands.end(), &Command::execute, &Command::undo);
+}
+
+void CompositeCommand::undo()
+{
+    applyAll(m_commands.rbegin(), m_commands.rend(), &Command::undo, &Command::redo);
+}
+
+void CompositeCommand::redo()
+{
+    applyAll(m_commands.begin(), m_commands.end(), &Command::redo, &Command::undo);
+}
+
+// When a command throws, the ones already applied are reverted,
+// and the document transaction is rolled back
+template <typename Iterator>
+void CompositeCommand::applyAll(Iterator first,
+                                Iterator last,
+                                void (Command::*apply)(),
+                                void (Command::*revert)())
+{
+    m_document.beginTransaction();
+
+    for (Iterator it = first; it != last; ++it) {
+        try {
+            ((**it).*apply)();
+        }
+        catch (...) {
+            // The first failure is the one worth reporting
+            try {
+                while (it != first)
+                    ((**--it).*revert)();
+            }
+            catch (...) {
+            }
+
+            m_document.rollbackTransaction();
+            throw;
+        }
+    }
+
+    m_document.commitTransaction();
+}
+
+std::size_t CompositeCommand::memoryCost() const
+{
+    std::size_t result = 0;
+
+    for (const std::shared_ptr<Command>& command : m_commands)
+        result += command->memoryCost();
+
+    return result;
 }
 
 } // namespace Slicer
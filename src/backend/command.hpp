@@ -18,6 +18,7 @@
 #define COMMAND_HPP
 
 #include "document.hpp"
+#include <functional>
 
 namespace Slicer {
 
@@ -35,6 +36,17 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
     virtual void redo() = 0;
+
+    // Roughly how much memory the command keeps alive while it's in the
+    // undo history. Only the pages that are out of the document count,
+    // as the document keeps the others alive anyway.
+    virtual std::size_t memoryCost() const;
+
+    // Folds a command executed right after this one into it, so that
+    // both are undone and redone as a single change. Only the history is
+    // folded: each command already changed the document, and notified the
+    // view, when it was executed. Returns false when they can't be folded.
+    virtual bool mergeWith(const Command& next);
 };
 
 class RemovePageCommand : public Command {
@@ -45,11 +57,13 @@ public:
     void execute() override;
     void undo() override;
     void redo() override;
+    std::size_t memoryCost() const override;
 
 private:
     Document& m_document;
     const unsigned int m_position;
     Glib::RefPtr<Page> m_removedPage;
+    bool m_isUndone = false;
 };
 
 class RemovePagesCommand : public Command {
@@ -60,11 +74,13 @@ public:
     void execute() override;
     void undo() override;
     void redo() override;
+    std::size_t memoryCost() const override;
 
 private:
     Document& m_document;
     const std::vector<unsigned int> m_listPositions;
     std::vector<Glib::RefPtr<Page>> m_removedPages;
+    bool m_isUndone = false;
 };
 
 class RemovePageRangeCommand : public Command {
@@ -76,39 +92,43 @@ public:
     void execute() override;
     void undo() override;
     void redo() override;
+    std::size_t memoryCost() const override;
 
 private:
     Document& m_document;
     std::vector<Glib::RefPtr<Page>> m_removedPages;
     const unsigned int m_first, m_last;
+    bool m_isUndone = false;
 };
 
-class RotatePagesRightCommand : public Command {
+// Quarter turns are clockwise when positive
+class RotatePagesCommand : public Command {
 public:
-    RotatePagesRightCommand(Document& document,
-                            const std::vector<unsigned int>& pageNumbers);
+    RotatePagesCommand(Document& document,
+                       const std::vector<unsigned int>& pageNumbers,
+                       int quarterTurns);
 
     void execute() override;
     void undo() override;
     void redo() override;
+    bool mergeWith(const Command& next) override;
 
 private:
     Document& m_document;
     const std::vector<unsigned int> m_pageNumbers;
+    int m_quarterTurns;
 };
 
-class RotatePagesLeftCommand : public Command {
+class RotatePagesRightCommand : public RotatePagesCommand {
+public:
+    RotatePagesRightCommand(Document& document,
+                            const std::vector<unsigned int>& pageNumbers);
+};
+
+class RotatePagesLeftCommand : public RotatePagesCommand {
 public:
     RotatePagesLeftCommand(Document& document,
                            const std::vector<unsigned int>& pageNumbers);
-
-    void execute() override;
-    void undo() override;
-    void redo() override;
-
-private:
-    Document& m_document;
-    const std::vector<unsigned int> m_pageNumbers;
 };
 
 class MovePageCommand : public Command {
@@ -120,11 +140,12 @@ public:
     void execute() override;
     void undo() override;
     void redo() override;
+    bool mergeWith(const Command& next) override;
 
 private:
     Document& m_document;
     const unsigned int m_indexToMove;
-    const unsigned int m_indexDestination;
+    unsigned int m_indexDestination;
 };
 
 class MovePageRangeCommand : public Command {
@@ -137,12 +158,13 @@ public:
     void execute() override;
     void undo() override;
     void redo() override;
+    bool mergeWith(const Command& next) override;
 
 private:
     Document& m_document;
     const unsigned int m_indexFirst;
     const unsigned int m_indexLast;
-    const unsigned int m_indexDestination;
+    unsigned int m_indexDestination;
 };
 
 class AddFilesCommand : public Command {
@@ -150,10 +172,17 @@ public:
     AddFilesCommand(Document& document,
                     const std::vector<Glib::RefPtr<Gio::File>>& files,
                     unsigned int position);
+    // For files that Document::addFiles() already added at the position.
+    // Executing the command then only takes note of their pages.
+    AddFilesCommand(Document& document,
+                    const std::vector<Glib::RefPtr<Gio::File>>& files,
+                    unsigned int position,
+                    unsigned int numberOfAddedPages);
 
     void execute() override;
     void undo() override;
     void redo() override;
+    std::size_t memoryCost() const override;
 
 protected:
     const std::vector<Glib::RefPtr<Gio::File>> m_files;
@@ -162,7 +191,67 @@ protected:
 
 private:
     Document& m_document;
+    const bool m_isAddedAhead = false;
     std::vector<Glib::RefPtr<Page>> m_addedPages;
+    bool m_isUndone = false;
+};
+
+class PermutePagesCommand : public Command {
+public:
+    // See Document::permutePages()
+    PermutePagesCommand(Document& document,
+                        const std::vector<unsigned int>& order);
+
+    void execute() override;
+    void undo() override;
+    void redo() override;
+    std::size_t memoryCost() const override;
+
+private:
+    Document& m_document;
+    const std::vector<unsigned int> m_order;
+};
+
+// Orders for PermutePagesCommand
+namespace PageOrder {
+    std::vector<unsigned int> reversed(unsigned int numberOfPages);
+
+    // Collates duplex scans: the first half of the pages are the fronts of
+    // the sheets, and the second half their backs, scanned in reverse when
+    // the stack was flipped over. With an odd number of pages, the last
+    // front has no back.
+    std::vector<unsigned int> interleaved(unsigned int numberOfPages, bool areBacksReversed);
+
+    // Stable, so pages that compare equal keep their relative order
+    std::vector<unsigned int> sortedBy(const Document& document,
+                                       const std::function<bool(const Page&, const Page&)>& isBefore);
+    std::vector<unsigned int> sortedBySourceFile(const Document& document);
+}
+
+// Commands that were executed one after the other, undone and redone
+// as one. The document only notifies the view once for all of them.
+class CompositeCommand : public Command {
+public:
+    CompositeCommand(Document& document);
+
+    // The command is added as already executed
+    void add(const std::shared_ptr<Command>& command);
+    bool isEmpty() const;
+
+    void execute() override;
+    void undo() override;
+    void redo() override;
+    std::size_t memoryCost() const override;
+
+private:
+    Document& m_document;
+    std::vector<std::shared_ptr<Command>> m_commands;
+
+    template <typename Iterator>
+    void applyAll(Iterator first,
+                  Iterator last,
+                  void (Command::*apply)(),
+                  void (Command::*revert)());
 };
 
 } // namespace Slicer
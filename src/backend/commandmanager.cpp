@@ -15,51 +15,197 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "commandmanager.hpp"
+#include <stdexcept>
 
 namespace Slicer {
 
+static const std::size_t defaultMaximumDepth = 100;
+static const std::size_t defaultMemoryBudget = 256 * 1024 * 1024;
+
+CommandManager::CommandManager()
+    : m_maximumDepth{defaultMaximumDepth}
+    , m_memoryBudget{defaultMemoryBudget}
+{
+}
+
 bool CommandManager::canUndo() const
 {
-    return !m_undoStack.empty();
+    return !m_undoHistory.empty();
 }
 
 bool CommandManager::canRedo() const
 {
-    return !m_redoStack.empty();
+    return !m_redoHistory.empty();
 }
 
 void CommandManager::execute(const std::shared_ptr<Command>& command)
 {
-    m_redoStack = CommandStack{};
+    if (m_transaction != nullptr) {
+        // What the transaction already did is undone along with it
+        try {
+            command->execute();
+        }
+        catch (...) {
+            rollbackTransaction();
+            throw;
+        }
+
+        m_transaction->add(command);
+
+        return;
+    }
+
+    clearRedoHistory();
     command->execute();
-    m_undoStack.push(command);
+
+    // Only what was just executed is folded into, never what was
+    // brought back by an undo or a redo
+    const std::size_t lastCost = m_canMergeWithLast ? m_undoHistory.back()->memoryCost() : 0;
+
+    if (m_canMergeWithLast && m_undoHistory.back()->mergeWith(*command)) {
+        updateHistoryCost(lastCost, m_undoHistory.back()->memoryCost());
+    }
+    else {
+        m_undoHistory.push_back(command);
+        m_historyCost += command->memoryCost();
+        trimHistory();
+    }
+
+    m_canMergeWithLast = true;
+
+    commandExecuted.emit();
+}
+
+void CommandManager::beginTransaction(Document& document)
+{
+    if (m_transaction != nullptr)
+        throw std::runtime_error("A transaction is already open");
+
+    document.beginTransaction();
+    m_transaction = std::make_shared<CompositeCommand>(document);
+    m_transactionDocument = &document;
+}
+
+void CommandManager::commitTransaction()
+{
+    if (m_transaction == nullptr)
+        throw std::runtime_error("There's no transaction to commit");
+
+    std::shared_ptr<CompositeCommand> transaction = std::move(m_transaction);
+    m_transaction.reset();
+    m_transactionDocument->commitTransaction();
+    m_transactionDocument = nullptr;
+
+    if (transaction->isEmpty())
+        return;
+
+    clearRedoHistory();
+    m_undoHistory.push_back(transaction);
+    m_historyCost += transaction->memoryCost();
+    m_canMergeWithLast = false;
+    trimHistory();
 
     commandExecuted.emit();
 }
 
+void CommandManager::rollbackTransaction()
+{
+    if (m_transaction == nullptr)
+        throw std::runtime_error("There's no transaction to roll back");
+
+    std::shared_ptr<CompositeCommand> transaction = std::move(m_transaction);
+    m_transaction.reset();
+
+    Document* document = m_transactionDocument;
+    m_transactionDocument = nullptr;
+
+    // Still inside the document transaction, so the view
+    // doesn't see the changes come and go
+    try {
+        transaction->undo();
+    }
+    catch (...) {
+        document->rollbackTransaction();
+        throw;
+    }
+
+    document->rollbackTransaction();
+}
+
 void CommandManager::undo()
 {
-    m_undoStack.top()->undo();
-    m_redoStack.push(m_undoStack.top());
-    m_undoStack.pop();
+    const std::size_t previousCost = m_undoHistory.back()->memoryCost();
+    m_undoHistory.back()->undo();
+    updateHistoryCost(previousCost, m_undoHistory.back()->memoryCost());
+    m_redoHistory.push_back(m_undoHistory.back());
+    m_undoHistory.pop_back();
+    m_canMergeWithLast = false;
 
     commandExecuted.emit();
 }
 
 void CommandManager::redo()
 {
-    m_redoStack.top()->redo();
-    m_undoStack.push(m_redoStack.top());
-    m_redoStack.pop();
+    const std::size_t previousCost = m_redoHistory.back()->memoryCost();
+    m_redoHistory.back()->redo();
+    updateHistoryCost(previousCost, m_redoHistory.back()->memoryCost());
+    m_undoHistory.push_back(m_redoHistory.back());
+    m_redoHistory.pop_back();
+    m_canMergeWithLast = false;
 
     commandExecuted.emit();
 }
 
 void CommandManager::reset()
 {
-    m_undoStack = {};
-    m_redoStack = {};
+    m_undoHistory.clear();
+    m_redoHistory.clear();
+    m_historyCost = 0;
+    m_canMergeWithLast = false;
 
     commandExecuted.emit();
 }
+
+void CommandManager::setHistoryLimits(std::size_t maximumDepth, std::size_t memoryBudget)
+{
+    m_maximumDepth = maximumDepth;
+    m_memoryBudget = memoryBudget;
+    trimHistory();
+}
+
+std::size_t CommandManager::historyDepth() const
+{
+    return m_undoHistory.size() + m_redoHistory.size();
+}
+
+std::size_t CommandManager::historyCost() const
+{
+    return m_historyCost;
+}
+
+// Forgetting a command releases the pages it holds. The copies of the
+// files they came from are only removed by Document::releaseUnusedFiles().
+void CommandManager::trimHistory()
+{
+    while (m_undoHistory.size() > 1
+           && (historyDepth() > m_maximumDepth || m_historyCost > m_memoryBudget)) {
+        m_historyCost -= m_undoHistory.front()->memoryCost();
+        m_undoHistory.pop_front();
+    }
+}
+
+void CommandManager::clearRedoHistory()
+{
+    for (const std::shared_ptr<Command>& command : m_redoHistory)
+        m_historyCost -= command->memoryCost();
+
+    m_redoHistory.clear();
+}
+
+// The cost of a command changes when it's undone or redone,
+// or when another one is folded into it
+void CommandManager::updateHistoryCost(std::size_t previousCost, std::size_t currentCost)
+{
+    m_historyCost = m_historyCost - previousCost + currentCost;
+}
 }
@@ -18,15 +18,26 @@
 #define COMMANDMANAGER_HPP
 
 #include "command.hpp"
-#include <stack>
+#include <deque>
 
 namespace Slicer {
 
 class CommandManager {
 public:
-    CommandManager() = default;
+    CommandManager();
 
+    // Commands that can be folded into the last executed one, like
+    // repeated moves of the same pages, are undone along with it, in
+    // a single change of the document
     void execute(const std::shared_ptr<Command>& command);
+
+    // Commands executed until the transaction is committed become a single
+    // entry of the history, and the document notifies the view once for all
+    // of them. Rolling back undoes them instead.
+    void beginTransaction(Document& document);
+    void commitTransaction();
+    void rollbackTransaction();
+
     void undo();
     void redo();
     void reset();
@@ -34,13 +45,32 @@ public:
     bool canUndo() const;
     bool canRedo() const;
 
+    // The oldest commands are forgotten once the history holds more than
+    // maximumDepth commands, or keeps more than memoryBudget bytes alive.
+    // The last executed command is always kept.
+    void setHistoryLimits(std::size_t maximumDepth, std::size_t memoryBudget);
+    std::size_t historyDepth() const;
+    // Kept up to date as commands come and go, and are undone or redone
+    std::size_t historyCost() const;
+
     sigc::signal<void> commandExecuted;
 
 private:
-    using CommandStack = std::stack<std::shared_ptr<Command>>;
+    // Most recent commands go last
+    using CommandHistory = std::deque<std::shared_ptr<Command>>;
+
+    CommandHistory m_undoHistory;
+    CommandHistory m_redoHistory;
+    std::size_t m_maximumDepth;
+    std::size_t m_memoryBudget;
+    std::size_t m_historyCost = 0;
+    bool m_canMergeWithLast = false;
+    std::shared_ptr<CompositeCommand> m_transaction;
+    Document* m_transactionDocument = nullptr;
 
-    CommandStack m_undoStack;
-    CommandStack m_redoStack;
+    void trimHistory();
+    void clearRedoHistory();
+    void updateHistoryCost(std::size_t previousCost, std::size_t currentCost);
 };
 }
 #endif // COMMANDMANAGER_HPP
@@ -0,0 +1,54 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "cpuexecutor.hpp"
+#include <thread>
+
+namespace Slicer {
+
+CpuExecutor::CpuExecutor()
+    : m_threadpool{defaultConcurrency()}
+{
+}
+
+CpuExecutor::~CpuExecutor()
+{
+    m_threadpool.wait();
+}
+
+CpuExecutor& CpuExecutor::instance()
+{
+    static CpuExecutor executor;
+
+    return executor;
+}
+
+int CpuExecutor::maxConcurrency() const
+{
+    return m_threadpool.pool_size();
+}
+
+int CpuExecutor::defaultConcurrency()
+{
+    const unsigned int numberOfCores = std::thread::hardware_concurrency();
+
+    if (numberOfCores >= 1)
+        return static_cast<int>(numberOfCores);
+
+    return 1;
+}
+
+} // namespace Slicer
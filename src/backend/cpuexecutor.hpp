@@ -0,0 +1,65 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CPUEXECUTOR_HPP
+#define CPUEXECUTOR_HPP
+
+#include "parallelfor.hpp"
+#include <threadpool.hpp>
+
+namespace Slicer {
+
+// Runs CPU-bound work of a save (compressing streams, resampling images)
+// on a pool with a thread per core, so it doesn't take the I/O threads
+// away from reads and writes.
+class CpuExecutor {
+public:
+    CpuExecutor(const CpuExecutor&) = delete;
+    CpuExecutor& operator=(const CpuExecutor&) = delete;
+    CpuExecutor(CpuExecutor&&) = delete;
+    CpuExecutor& operator=(CpuExecutor&& src) = delete;
+
+    ~CpuExecutor();
+
+    static CpuExecutor& instance();
+
+    // Same as IoExecutor::parallelFor()
+    template <typename F>
+    void parallelFor(std::size_t count, F function);
+
+    [[nodiscard]] int maxConcurrency() const;
+
+private:
+    CpuExecutor();
+
+    static int defaultConcurrency();
+
+    astp::ThreadPool m_threadpool;
+};
+
+template <typename F>
+void CpuExecutor::parallelFor(std::size_t count, F function)
+{
+    detail::parallelFor(m_threadpool,
+                        static_cast<std::size_t>(maxConcurrency()),
+                        count,
+                        std::move(function),
+                        []() {});
+}
+
+} // namespace Slicer
+
+#endif // CPUEXECUTOR_HPP
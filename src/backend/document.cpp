@@ -15,19 +15,53 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "document.hpp"
+#include "ioexecutor.hpp"
 #include "tempfile.hpp"
+#include <algorithm>
 #include <glibmm/convert.h>
+#include <mutex>
 #include <numeric>
+#include <set>
 #include <range/v3/view/enumerate.hpp>
 
 namespace Slicer {
 
+// Splices into the list only the pages between the unchanged start and
+// the unchanged end of it. Returns the new positions that were replaced,
+// from first up to, but not including, last.
+static std::pair<unsigned int, unsigned int> replaceChangedPages(const Glib::RefPtr<Gio::ListStore<Page>>& list,
+                                                                 const std::vector<Glib::RefPtr<Page>>& pages)
+{
+    const auto oldSize = list->get_n_items();
+    const auto newSize = static_cast<unsigned int>(pages.size());
+    const unsigned int commonSize = std::min(oldSize, newSize);
+
+    unsigned int prefix = 0;
+
+    while (prefix < commonSize && list->get_item(prefix) == pages.at(prefix))
+        ++prefix;
+
+    unsigned int suffix = 0;
+
+    while (suffix < commonSize - prefix && list->get_item(oldSize - 1 - suffix) == pages.at(newSize - 1 - suffix))
+        ++suffix;
+
+    const std::vector<Glib::RefPtr<Page>> changedPages{pages.begin() + prefix, pages.end() - suffix};
+
+    if (oldSize - prefix - suffix > 0 || !changedPages.empty())
+        list->splice(prefix, oldSize - prefix - suffix, changedPages);
+
+    return {prefix, newSize - suffix};
+}
+
 Document::Document(const Glib::RefPtr<Gio::File>& sourceFile)
     : m_pages{Gio::ListStore<Page>::create()}
+    , m_saveSession{std::make_shared<PdfSaver::Session>()}
 {
     FileData fileData = loadFile(sourceFile);
     m_pages->splice(0, 0, loadPages(fileData, 0));
-
+    fileData.pagesDocument = fileData.popplerDocument;
+    fileData.popplerDocument.reset();
     m_filesData.emplace_back(std::move(fileData));
 }
 
@@ -38,6 +72,26 @@ Document::Document(const std::vector<Glib::RefPtr<Gio::File>>& sourceFiles) : Do
     addFiles(additional_files, m_pages->get_n_items());
 }
 
+// Files still loading are dropped, along with the copies of those
+// already loaded, and their futures are canceled
+Document::~Document()
+{
+    for (const std::weak_ptr<AddingFiles>& weakAddingFiles : m_addingFiles) {
+        std::shared_ptr<AddingFiles> addingFiles = weakAddingFiles.lock();
+
+        if (addingFiles == nullptr)
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock{addingFiles->mutex};
+            addingFiles->document = nullptr;
+            removeTempFiles(addingFiles->loadedFiles);
+        }
+
+        addingFiles->promise.cancel();
+    }
+}
+
 Glib::RefPtr<Page> Document::removePage(unsigned int index)
 {
     Glib::RefPtr<Page> removedPage = m_pages->get_item(index);
@@ -121,7 +175,7 @@ void Document::movePage(unsigned int indexToMove, unsigned int indexDestination)
     pageToMove->setDocumentIndex(indexDestination);
     insertPage(pageToMove);
 
-    pagesReordered.emit({indexDestination});
+    notifyPagesReordered({indexDestination});
 }
 
 void Document::movePageRange(unsigned int indexFirst,
@@ -139,7 +193,55 @@ void Document::movePageRange(unsigned int indexFirst,
     std::vector<unsigned int> reorderedIndexes(numberOfPages);
     std::iota(reorderedIndexes.begin(), reorderedIndexes.end(), indexDestination);
 
-    pagesReordered.emit(reorderedIndexes);
+    notifyPagesReordered(reorderedIndexes);
+}
+
+void Document::permutePages(const std::vector<unsigned int>& order)
+{
+    checkPermutation(order);
+
+    std::vector<Glib::RefPtr<Page>> pages;
+    pages.reserve(order.size());
+
+    for (unsigned int position : order)
+        pages.push_back(m_pages->get_item(position));
+
+    applyPageOrder(pages);
+}
+
+void Document::restorePageOrder(const std::vector<unsigned int>& order)
+{
+    checkPermutation(order);
+
+    std::vector<Glib::RefPtr<Page>> pages(order.size());
+
+    for (unsigned int i = 0; i < order.size(); ++i)
+        pages.at(order.at(i)) = m_pages->get_item(i);
+
+    applyPageOrder(pages);
+}
+
+void Document::checkPermutation(const std::vector<unsigned int>& order) const
+{
+    if (order.size() != numberOfPages())
+        throw std::runtime_error("The new order doesn't have every page of the document");
+
+    std::vector<bool> isTaken(order.size(), false);
+
+    for (unsigned int position : order) {
+        if (position >= order.size() || isTaken.at(position))
+            throw std::runtime_error("The new order doesn't have every page of the document exactly once");
+
+        isTaken.at(position) = true;
+    }
+}
+
+void Document::applyPageOrder(const std::vector<Glib::RefPtr<Page>>& pages)
+{
+    for (unsigned int i = 0; i < pages.size(); ++i)
+        pages.at(i)->setDocumentIndex(i);
+
+    replaceChangedPages(m_pages, pages);
 }
 
 void Document::rotatePagesRight(const std::vector<unsigned int>& pageNumbers)
@@ -147,7 +249,7 @@ void Document::rotatePagesRight(const std::vector<unsigned int>& pageNumbers)
     for (unsigned int pageNumber : pageNumbers)
         m_pages->get_item(pageNumber)->rotateRight();
 
-    pagesRotated.emit(pageNumbers);
+    notifyPagesRotated(pageNumbers);
 }
 
 void Document::rotatePagesLeft(const std::vector<unsigned int>& pageNumbers)
@@ -155,18 +257,32 @@ void Document::rotatePagesLeft(const std::vector<unsigned int>& pageNumbers)
     for (unsigned int pageNumber : pageNumbers)
         m_pages->get_item(pageNumber)->rotateLeft();
 
-    pagesRotated.emit(pageNumbers);
+    notifyPagesRotated(pageNumbers);
+}
+
+void Document::rotatePages(const std::vector<unsigned int>& pageNumbers, int quarterTurns)
+{
+    for (unsigned int pageNumber : pageNumbers)
+        m_pages->get_item(pageNumber)->rotate(quarterTurns);
+
+    notifyPagesRotated(pageNumbers);
 }
 
 unsigned int Document::addFile(const Glib::RefPtr<Gio::File>& file, unsigned int position)
 {
-    FileData fileData = loadFile(file);
+    return insertFile(loadFile(file), position);
+}
+
+unsigned int Document::insertFile(FileData fileData, unsigned int position)
+{
     std::vector<Glib::RefPtr<Page>> pages = loadPages(fileData, m_filesData.size());
 
     for (auto [i, page] : ranges::views::enumerate(pages))
         page->setDocumentIndex(position + i);
 
     insertPageRange(pages, position);
+    fileData.pagesDocument = fileData.popplerDocument;
+    fileData.popplerDocument.reset();
     m_filesData.emplace_back(std::move(fileData));
 
     return pages.size();
@@ -175,17 +291,144 @@ unsigned int Document::addFile(const Glib::RefPtr<Gio::File>& file, unsigned int
 unsigned int Document::addFiles(const std::vector<Glib::RefPtr<Gio::File>>& files,
                                 unsigned int position)
 {
+    // The calling thread loads files too, so this can't deadlock
+    // when called from the I/O executor itself. Every load finishes
+    // before a failure is rethrown, so no copy is left behind.
+    std::vector<std::optional<FileData>> loadedFiles(files.size());
+
+    try {
+        IoExecutor::instance().parallelFor(files.size(), [&files, &loadedFiles](std::size_t i) {
+            loadedFiles.at(i) = loadFile(files.at(i));
+        });
+    }
+    catch (...) {
+        removeTempFiles(loadedFiles);
+        throw;
+    }
+
     unsigned int totalNumberOfInsertedPages = 0;
 
-    for (const auto& file : files) {
-        unsigned int numberOfInsertedPages = addFile(file, position);
-        position += numberOfInsertedPages;
-        totalNumberOfInsertedPages += numberOfInsertedPages;
-    }
+    for (const auto& loadedFile : loadedFiles)
+        totalNumberOfInsertedPages += insertFile(*loadedFile, position + totalNumberOfInsertedPages);
 
     return totalNumberOfInsertedPages;
 }
 
+struct Document::AddingFiles {
+    // Held by whichever of the continuations and the destructor of the
+    // document runs, as the scheduler may run continuations on any thread
+    std::mutex mutex;
+    // Null once the document is gone
+    Document* document = nullptr;
+    std::vector<std::optional<FileData>> loadedFiles;
+    std::size_t numberOfFinishedLoads = 0;
+    std::size_t nextFileToInsert = 0;
+    unsigned int position = 0;
+    unsigned int numberOfInsertedPages = 0;
+    std::exception_ptr exception;
+    Promise<unsigned int> promise;
+};
+
+Future<unsigned int> Document::addFiles(const std::vector<Glib::RefPtr<Gio::File>>& files,
+                                        unsigned int position,
+                                        const Scheduler& scheduler)
+{
+    auto addingFiles = std::make_shared<AddingFiles>();
+    addingFiles->document = this;
+    addingFiles->loadedFiles.resize(files.size());
+    addingFiles->position = position;
+
+    if (files.empty())
+        addingFiles->promise.setValue(0);
+
+    m_addingFiles.erase(std::remove_if(m_addingFiles.begin(),
+                                       m_addingFiles.end(),
+                                       [](const std::weak_ptr<AddingFiles>& weakAddingFiles) {
+                                           return weakAddingFiles.expired();
+                                       }),
+                        m_addingFiles.end());
+    m_addingFiles.push_back(addingFiles);
+
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        Promise<FileData> loading;
+
+        (void) IoExecutor::instance().submit([loading, file = files.at(i)]() {
+            auto load = [&file]() {
+                return loadFile(file);
+            };
+
+            loading.fulfil(load);
+        });
+
+        loading.future().then(scheduler, [addingFiles, i](const FileData& fileData) {
+            std::lock_guard<std::mutex> lock{addingFiles->mutex};
+
+            if (addingFiles->document == nullptr) {
+                removeTempFiles({fileData});
+                return;
+            }
+
+            addingFiles->loadedFiles.at(i) = fileData;
+            addingFiles->document->insertLoadedFiles(*addingFiles);
+        });
+
+        loading.future().onFailure(scheduler, [addingFiles](const std::exception_ptr& exception) {
+            std::lock_guard<std::mutex> lock{addingFiles->mutex};
+
+            if (addingFiles->document == nullptr)
+                return;
+
+            if (addingFiles->exception == nullptr)
+                addingFiles->exception = exception;
+
+            addingFiles->document->insertLoadedFiles(*addingFiles);
+        });
+    }
+
+    return addingFiles->promise.future();
+}
+
+void Document::insertLoadedFiles(AddingFiles& addingFiles)
+{
+    ++addingFiles.numberOfFinishedLoads;
+
+    // Files go in in order, each one as soon as the ones before it are in
+    while (addingFiles.exception == nullptr
+           && addingFiles.nextFileToInsert < addingFiles.loadedFiles.size()
+           && addingFiles.loadedFiles.at(addingFiles.nextFileToInsert).has_value()) {
+        std::optional<FileData>& loadedFile = addingFiles.loadedFiles.at(addingFiles.nextFileToInsert);
+
+        try {
+            addingFiles.numberOfInsertedPages += insertFile(*loadedFile,
+                                                            addingFiles.position + addingFiles.numberOfInsertedPages);
+        }
+        catch (...) {
+            addingFiles.exception = std::current_exception();
+            break;
+        }
+
+        loadedFile.reset();
+        ++addingFiles.nextFileToInsert;
+    }
+
+    if (addingFiles.numberOfFinishedLoads < addingFiles.loadedFiles.size())
+        return;
+
+    if (addingFiles.exception == nullptr) {
+        addingFiles.promise.setValue(addingFiles.numberOfInsertedPages);
+        return;
+    }
+
+    // The files that didn't get in don't need their copies.
+    // The ones that did stay in m_filesData, like those of an undone add.
+    removeTempFiles(addingFiles.loadedFiles);
+
+    if (addingFiles.numberOfInsertedPages > 0)
+        removePageRange(addingFiles.position, addingFiles.position + addingFiles.numberOfInsertedPages - 1);
+
+    addingFiles.promise.setException(addingFiles.exception);
+}
+
 Glib::RefPtr<Page> Document::getPage(unsigned int index) const
 {
     return m_pages->get_item(index);
@@ -193,7 +436,111 @@ Glib::RefPtr<Page> Document::getPage(unsigned int index) const
 
 const Glib::RefPtr<Gio::ListStore<Page>>& Document::pages() const
 {
-    return m_pages;
+    return m_committedPages ? m_committedPages : m_pages;
+}
+
+void Document::beginTransaction()
+{
+    m_transactionMarks.emplace_back(m_reorderedPages.size(), m_rotatedPages.size());
+
+    if (m_transactionDepth++ > 0)
+        return;
+
+    std::vector<Glib::RefPtr<Page>> pages;
+
+    for (unsigned int i = 0; i < m_pages->get_n_items(); ++i)
+        pages.push_back(m_pages->get_item(i));
+
+    m_committedPages = m_pages;
+    m_pages = Gio::ListStore<Page>::create();
+    m_pages->splice(0, 0, pages);
+}
+
+void Document::commitTransaction()
+{
+    if (m_transactionDepth == 0)
+        throw std::runtime_error("There's no transaction to commit");
+
+    m_transactionMarks.pop_back();
+
+    if (--m_transactionDepth > 0)
+        return;
+
+    std::vector<Glib::RefPtr<Page>> pages;
+
+    for (unsigned int i = 0; i < m_pages->get_n_items(); ++i)
+        pages.push_back(m_pages->get_item(i));
+
+    m_pages = m_committedPages;
+    m_committedPages.reset();
+
+    const auto [firstReplaced, lastReplaced] = replaceChangedPages(m_pages, pages);
+    const std::vector<unsigned int> reorderedPositions = positionsOf(m_reorderedPages);
+    std::vector<unsigned int> rotatedPositions;
+
+    // Replaced pages are rendered anew anyway
+    for (unsigned int position : positionsOf(m_rotatedPages))
+        if (position < firstReplaced || position >= lastReplaced)
+            rotatedPositions.push_back(position);
+
+    m_reorderedPages.clear();
+    m_rotatedPages.clear();
+
+    if (!reorderedPositions.empty())
+        pagesReordered.emit(reorderedPositions);
+
+    if (!rotatedPositions.empty())
+        pagesRotated.emit(rotatedPositions);
+}
+
+void Document::rollbackTransaction()
+{
+    if (m_transactionDepth == 0)
+        throw std::runtime_error("There's no transaction to roll back");
+
+    const auto [numberOfReorderedPages, numberOfRotatedPages] = m_transactionMarks.back();
+    m_reorderedPages.resize(numberOfReorderedPages);
+    m_rotatedPages.resize(numberOfRotatedPages);
+
+    commitTransaction();
+}
+
+void Document::notifyPagesReordered(const std::vector<unsigned int>& positions)
+{
+    if (m_transactionDepth == 0) {
+        pagesReordered.emit(positions);
+        return;
+    }
+
+    // Positions still change until the transaction is committed
+    for (unsigned int position : positions)
+        m_reorderedPages.push_back(m_pages->get_item(position));
+}
+
+void Document::notifyPagesRotated(const std::vector<unsigned int>& positions)
+{
+    if (m_transactionDepth == 0) {
+        pagesRotated.emit(positions);
+        return;
+    }
+
+    for (unsigned int position : positions)
+        m_rotatedPages.push_back(m_pages->get_item(position));
+}
+
+// The sorted positions of the pages that are still in the document
+std::vector<unsigned int> Document::positionsOf(const std::vector<Glib::RefPtr<Page>>& pages) const
+{
+    std::set<unsigned int> result;
+
+    for (const Glib::RefPtr<Page>& page : pages) {
+        const unsigned int position = page->getDocumentIndex();
+
+        if (position < m_pages->get_n_items() && m_pages->get_item(position) == page)
+            result.insert(position);
+    }
+
+    return {result.begin(), result.end()};
 }
 
 unsigned int Document::numberOfPages() const
@@ -210,8 +557,12 @@ PdfSaver::SaveData Document::getSaveData() const
 {
     PdfSaver::SaveData result;
 
-    for (const FileData& fileData : m_filesData)
+    for (const FileData& fileData : m_filesData) {
         result.files.push_back(fileData.tempFile);
+        result.fileVersions.push_back(fileData.originalVersion);
+    }
+
+    result.session = m_saveSession;
 
     for (unsigned int i = 0; i < m_pages->get_n_items(); ++i) {
         Glib::RefPtr<Page> page = m_pages->get_item(i);
@@ -223,21 +574,79 @@ PdfSaver::SaveData Document::getSaveData() const
     return result;
 }
 
-Document::FileData Document::loadFile(const Glib::RefPtr<Gio::File>& sourceFile)
+// Released files stay in m_filesData, so the pages of the
+// others keep their file numbers
+void Document::releaseUnusedFiles()
 {
-    std::unique_ptr<poppler::document> tempDocument{poppler::document::load_from_file(sourceFile->get_path())};
-
-    if (tempDocument == nullptr)
-        throw std::runtime_error("Couldn't load file: " + sourceFile->get_path());
-
-    Glib::RefPtr<Gio::File> tempFile = TempFile::generate();
-    sourceFile->copy(tempFile, Gio::FILE_COPY_OVERWRITE);
+    for (std::size_t i = 1; i < m_filesData.size(); ++i) {
+        FileData& fileData = m_filesData.at(i);
+
+        if (fileData.isReleased || !fileData.pagesDocument.expired())
+            continue;
+
+        fileData.isReleased = true;
+
+        // A copy left behind isn't worth failing the edit that released it
+        try {
+            IoExecutor::instance().run([&fileData]() {
+                fileData.tempFile->remove();
+            });
+        }
+        catch (...) {
+        }
+    }
+}
 
-    std::unique_ptr<poppler::document> document{poppler::document::load_from_file(tempFile->get_path())};
+Document::FileData Document::loadFile(const Glib::RefPtr<Gio::File>& sourceFile)
+{
+    return IoExecutor::instance().run([&sourceFile]() {
+        std::unique_ptr<poppler::document> tempDocument{poppler::document::load_from_file(sourceFile->get_path())};
+
+        if (tempDocument == nullptr)
+            throw std::runtime_error("Couldn't load file: " + sourceFile->get_path());
+
+        // Like any version made of modification times, it misses
+        // changes made to the original while it's being copied
+        const Glib::RefPtr<Gio::FileInfo> info = sourceFile->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE
+                                                                        "," G_FILE_ATTRIBUTE_TIME_MODIFIED
+                                                                        "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        const std::string originalVersion = sourceFile->get_uri()
+                                            + " " + std::to_string(info->get_size())
+                                            + " " + std::to_string(info->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED))
+                                            + "." + std::to_string(info->get_attribute_uint32(G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+
+        Glib::RefPtr<Gio::File> tempFile = TempFile::copyFrom(sourceFile);
+
+        std::shared_ptr<poppler::document> document{poppler::document::load_from_file(tempFile->get_path())};
+
+        if (document == nullptr) {
+            tempFile->remove();
+            throw std::runtime_error("Couldn't load file: " + sourceFile->get_path());
+        }
+
+        return FileData{sourceFile,
+                        tempFile,
+                        originalVersion,
+                        std::move(document)};
+    });
+}
 
-    return FileData{sourceFile,
-                    tempFile,
-                    std::move(document)};
+// Failing to remove a copy isn't worth reporting over the error
+// that made it useless
+void Document::removeTempFiles(const std::vector<std::optional<FileData>>& filesData)
+{
+    for (const auto& fileData : filesData) {
+        if (!fileData.has_value())
+            continue;
+
+        try {
+            IoExecutor::instance().run([&fileData]() {
+                fileData->tempFile->remove();
+            });
+        }
+        catch (...) {
+        }
+    }
 }
 
 std::vector<Glib::RefPtr<Page>> Document::loadPages(const Document::FileData& fileData,
@@ -252,7 +661,8 @@ std::vector<Glib::RefPtr<Page>> Document::loadPages(const Document::FileData& fi
         if (ppage == nullptr)
             throw std::runtime_error("Couldn't load page with number: " + std::to_string(i));
 
-        auto page = Glib::RefPtr<Page>{new Page{std::move(ppage),
+        auto page = Glib::RefPtr<Page>{new Page{fileData.popplerDocument,
+                                                std::move(ppage),
                                                 basename,
                                                 fileNumber,
                                                 static_cast<unsigned>(i)}};
@@ -17,10 +17,12 @@
 #ifndef DOCUMENT_HPP
 #define DOCUMENT_HPP
 
+#include "future.hpp"
 #include "page.hpp"
 #include "pdfsaver.hpp"
 #include <giomm/file.h>
 #include <giomm/liststore.h>
+#include <optional>
 #include <poppler/cpp/poppler-document.h>
 #include <vector>
 
@@ -30,6 +32,7 @@ class Document {
 public:
     Document(const Glib::RefPtr<Gio::File>& sourceFile);
     Document(const std::vector<Glib::RefPtr<Gio::File>>& sourceFiles);
+    ~Document();
 
     Glib::RefPtr<Page> removePage(unsigned int index);
     std::vector<Glib::RefPtr<Page>> removePages(const std::vector<unsigned int>& indexes);
@@ -44,11 +47,38 @@ public:
                        unsigned int indexLast,
                        unsigned int indexDestination);
 
+    // order holds, for every new position, the current position of the
+    // page that goes there. The view gets a single items-changed.
+    void permutePages(const std::vector<unsigned int>& order);
+    // Undoes permutePages() called with the same order
+    void restorePageOrder(const std::vector<unsigned int>& order);
+
     void rotatePagesRight(const std::vector<unsigned int>& pageNumbers);
     void rotatePagesLeft(const std::vector<unsigned int>& pageNumbers);
+    // Quarter turns are clockwise when positive
+    void rotatePages(const std::vector<unsigned int>& pageNumbers, int quarterTurns);
+
+    // Changes made between these reach the view at once when the outermost
+    // transaction is committed: a single items-changed for the pages that
+    // differ, then pagesReordered and pagesRotated for the pages involved.
+    // Transactions can be nested. Rolling back only drops what the
+    // changes since the matching begin would notify, so they have to be
+    // undone already.
+    void beginTransaction();
+    void commitTransaction();
+    void rollbackTransaction();
 
     unsigned int addFile(const Glib::RefPtr<Gio::File>& file, unsigned int position);
+    // Either every file is added, or none of them is
     unsigned int addFiles(const std::vector<Glib::RefPtr<Gio::File>>& files, unsigned int position);
+    // Loads the files in parallel and splices the pages of each one from
+    // the scheduler (usually the main loop) as soon as it, and the files
+    // before it, are loaded. Resolves with the number of added pages.
+    // When a file fails, the pages already spliced are removed again.
+    // Destroying the document cancels the returned future.
+    Future<unsigned int> addFiles(const std::vector<Glib::RefPtr<Gio::File>>& files,
+                                  unsigned int position,
+                                  const Scheduler& scheduler);
 
     Glib::RefPtr<Page> getPage(unsigned int index) const;
     const Glib::RefPtr<Gio::ListStore<Page>>& pages() const;
@@ -57,6 +87,11 @@ public:
 
     PdfSaver::SaveData getSaveData() const;
 
+    // Removes the copies of the files none of whose pages are alive,
+    // in the document or anywhere else, like the undo history. The copy
+    // of the first file is kept, as every save is built from it.
+    void releaseUnusedFiles();
+
     sigc::signal<void, std::vector<unsigned int>> pagesRotated;
     sigc::signal<void, std::vector<unsigned int>> pagesReordered;
 
@@ -64,14 +99,43 @@ private:
     struct FileData {
         Glib::RefPtr<Gio::File> originalFile;
         Glib::RefPtr<Gio::File> tempFile;
-        std::unique_ptr<poppler::document> popplerDocument;
+        // The location, size and modification time of the original file
+        // when it was copied, see PdfSaver::SaveData::fileVersions
+        std::string originalVersion;
+        // Only held until the pages are loaded, which then keep it alive
+        std::shared_ptr<poppler::document> popplerDocument;
+        // Expires along with the last of the pages
+        std::weak_ptr<poppler::document> pagesDocument;
+        bool isReleased = false;
     };
 
+    struct AddingFiles;
+
     static FileData loadFile(const Glib::RefPtr<Gio::File>& sourceFile);
+    static void removeTempFiles(const std::vector<std::optional<FileData>>& filesData);
+    unsigned int insertFile(FileData fileData, unsigned int position);
+    void insertLoadedFiles(AddingFiles& addingFiles);
     static std::vector<Glib::RefPtr<Page>> loadPages(const FileData& fileData, unsigned int fileNumber);
 
+    void checkPermutation(const std::vector<unsigned int>& order) const;
+    void applyPageOrder(const std::vector<Glib::RefPtr<Page>>& pages);
+    void notifyPagesReordered(const std::vector<unsigned int>& positions);
+    void notifyPagesRotated(const std::vector<unsigned int>& positions);
+    std::vector<unsigned int> positionsOf(const std::vector<Glib::RefPtr<Page>>& pages) const;
+
     std::vector<FileData> m_filesData;
     Glib::RefPtr<Gio::ListStore<Page>> m_pages;
+    // While a transaction is open, m_pages is a scratch copy, and this
+    // is the list the view is bound to
+    Glib::RefPtr<Gio::ListStore<Page>> m_committedPages;
+    unsigned int m_transactionDepth = 0;
+    std::vector<Glib::RefPtr<Page>> m_reorderedPages;
+    std::vector<Glib::RefPtr<Page>> m_rotatedPages;
+    // How many reordered and rotated pages there were when
+    // each of the open transactions began
+    std::vector<std::pair<std::size_t, std::size_t>> m_transactionMarks;
+    std::shared_ptr<PdfSaver::Session> m_saveSession;
+    std::vector<std::weak_ptr<AddingFiles>> m_addingFiles;
 };
 }
 
@@ -0,0 +1,414 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FUTURE_HPP
+#define FUTURE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace Slicer {
+
+class TaskCanceled : public std::runtime_error {
+public:
+    TaskCanceled()
+        : std::runtime_error{"The task was canceled"}
+    {
+    }
+};
+
+// Decides where a continuation runs: the main loop, a worker thread,
+// the I/O executor, or right away in the thread that completed the future.
+using Scheduler = std::function<void(std::function<void()>)>;
+
+inline void runInline(const std::function<void()>& function)
+{
+    function();
+}
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+namespace detail {
+
+    template <typename T>
+    using StoredType = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template <typename T>
+    struct FutureState {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool isDone = false;
+        std::optional<StoredType<T>> value;
+        std::exception_ptr exception;
+        std::atomic_bool isCanceled = false;
+        std::vector<std::function<void()>> continuations;
+        std::vector<std::function<void()>> cancelHandlers;
+    };
+
+    template <typename T>
+    void complete(const std::shared_ptr<FutureState<T>>& state,
+                  std::optional<StoredType<T>> value,
+                  std::exception_ptr exception)
+    {
+        std::vector<std::function<void()>> continuations;
+
+        {
+            std::lock_guard<std::mutex> lock{state->mutex};
+
+            if (state->isDone)
+                return;
+
+            state->value = std::move(value);
+            state->exception = std::move(exception);
+            state->isDone = true;
+            continuations.swap(state->continuations);
+        }
+
+        state->condition.notify_all();
+
+        for (auto& continuation : continuations)
+            continuation();
+    }
+
+    // Cancellation is a completion too. Whichever of cancel() and complete()
+    // takes the lock first wins, so a future is never both canceled
+    // and holding a value.
+    template <typename T>
+    void cancel(const std::shared_ptr<FutureState<T>>& state)
+    {
+        std::vector<std::function<void()>> cancelHandlers;
+        std::vector<std::function<void()>> continuations;
+
+        {
+            std::lock_guard<std::mutex> lock{state->mutex};
+
+            if (state->isDone)
+                return;
+
+            state->exception = std::make_exception_ptr(TaskCanceled{});
+            state->isCanceled = true;
+            state->isDone = true;
+            cancelHandlers.swap(state->cancelHandlers);
+            continuations.swap(state->continuations);
+        }
+
+        state->condition.notify_all();
+
+        for (auto& handler : cancelHandlers)
+            handler();
+
+        for (auto& continuation : continuations)
+            continuation();
+    }
+
+    template <typename T>
+    void addContinuation(const std::shared_ptr<FutureState<T>>& state,
+                         std::function<void()> continuation)
+    {
+        {
+            std::lock_guard<std::mutex> lock{state->mutex};
+
+            if (!state->isDone) {
+                state->continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+
+        continuation();
+    }
+
+} // namespace detail
+
+template <typename T>
+class Future {
+public:
+    using ValueType = T;
+
+    Future() = default;
+
+    // A default constructed future has no state: it's never ready,
+    // canceling it does nothing, and waiting on it throws.
+    [[nodiscard]] bool isValid() const { return m_state != nullptr; }
+
+    [[nodiscard]] bool isReady() const
+    {
+        if (!isValid())
+            return false;
+
+        std::lock_guard<std::mutex> lock{m_state->mutex};
+        return m_state->isDone;
+    }
+
+    [[nodiscard]] bool isCanceled() const { return isValid() && m_state->isCanceled; }
+
+    // Cancels this future and everything chained after it.
+    // Work that already started runs to completion, but its result is dropped.
+    void cancel()
+    {
+        if (isValid())
+            detail::cancel<T>(m_state);
+    }
+
+    void wait() const
+    {
+        throwIfInvalid();
+
+        std::unique_lock<std::mutex> lock{m_state->mutex};
+        m_state->condition.wait(lock, [this]() { return m_state->isDone; });
+    }
+
+    // Blocks until the result is available, rethrowing any exception
+    T get() const
+    {
+        wait();
+
+        if (m_state->exception != nullptr)
+            std::rethrow_exception(m_state->exception);
+
+        if constexpr (std::is_void_v<T>)
+            return;
+        else
+            return *m_state->value;
+    }
+
+    // Runs the function with this future's value once it's available.
+    // Exceptions and cancellation skip the function and propagate
+    // to the returned future.
+    template <typename F>
+    auto then(const Scheduler& scheduler, F function) const;
+
+    // Runs the function only if this future failed or was canceled
+    template <typename F>
+    void onFailure(const Scheduler& scheduler, F function) const;
+
+    // Registers a function that runs when this future is canceled
+    // before completing, e.g. to stop the work that would produce it.
+    void onCancel(std::function<void()> handler) const
+    {
+        throwIfInvalid();
+
+        {
+            std::lock_guard<std::mutex> lock{m_state->mutex};
+
+            if (!m_state->isCanceled) {
+                if (!m_state->isDone)
+                    m_state->cancelHandlers.push_back(std::move(handler));
+
+                return;
+            }
+        }
+
+        handler();
+    }
+
+private:
+    std::shared_ptr<detail::FutureState<T>> m_state;
+
+    void throwIfInvalid() const
+    {
+        if (!isValid())
+            throw std::runtime_error("The future has no state");
+    }
+
+    explicit Future(std::shared_ptr<detail::FutureState<T>> state)
+        : m_state{std::move(state)}
+    {
+    }
+
+    friend class Promise<T>;
+
+    template <typename U>
+    friend class Future;
+};
+
+template <typename T>
+class Promise {
+public:
+    Promise()
+        : m_state{std::make_shared<detail::FutureState<T>>()}
+    {
+    }
+
+    [[nodiscard]] Future<T> future() const { return Future<T>{m_state}; }
+
+    [[nodiscard]] bool isCanceled() const { return m_state->isCanceled; }
+
+    template <typename U = T, typename = std::enable_if_t<!std::is_void_v<U>>>
+    void setValue(U value) const
+    {
+        detail::complete<T>(m_state, std::move(value), nullptr);
+    }
+
+    template <typename U = T, typename = std::enable_if_t<std::is_void_v<U>>>
+    void setValue() const
+    {
+        detail::complete<T>(m_state, std::monostate{}, nullptr);
+    }
+
+    void setException(std::exception_ptr exception) const
+    {
+        detail::complete<T>(m_state, {}, std::move(exception));
+    }
+
+    void cancel() const { detail::cancel<T>(m_state); }
+
+    // Runs the function and stores either its result or its exception
+    template <typename F, typename... Args>
+    void fulfil(F& function, Args&&... args) const
+    {
+        if (isCanceled())
+            return;
+
+        try {
+            if constexpr (std::is_void_v<T>) {
+                function(std::forward<Args>(args)...);
+                setValue();
+            }
+            else {
+                setValue(function(std::forward<Args>(args)...));
+            }
+        }
+        catch (...) {
+            setException(std::current_exception());
+        }
+    }
+
+private:
+    std::shared_ptr<detail::FutureState<T>> m_state;
+};
+
+template <typename T>
+template <typename F>
+auto Future<T>::then(const Scheduler& scheduler, F function) const
+{
+    using Result = std::conditional_t<std::is_void_v<T>,
+                                      std::invoke_result<F>,
+                                      std::invoke_result<F, const detail::StoredType<T>&>>;
+    using R = typename Result::type;
+
+    throwIfInvalid();
+
+    Promise<R> promise;
+    std::shared_ptr<detail::FutureState<T>> state = m_state;
+
+    detail::addContinuation<T>(state, [scheduler, state, promise, function]() mutable {
+        if (state->isCanceled) {
+            promise.cancel();
+            return;
+        }
+
+        if (state->exception != nullptr) {
+            promise.setException(state->exception);
+            return;
+        }
+
+        scheduler([state, promise, function]() mutable {
+            if constexpr (std::is_void_v<T>)
+                promise.fulfil(function);
+            else
+                promise.fulfil(function, *state->value);
+        });
+    });
+
+    return promise.future();
+}
+
+template <typename T>
+template <typename F>
+void Future<T>::onFailure(const Scheduler& scheduler, F function) const
+{
+    throwIfInvalid();
+
+    std::shared_ptr<detail::FutureState<T>> state = m_state;
+
+    detail::addContinuation<T>(state, [scheduler, state, function]() {
+        if (state->exception == nullptr)
+            return;
+
+        scheduler([state, function]() {
+            function(state->exception);
+        });
+    });
+}
+
+// Resolves once every future is done, or as soon as one of them fails.
+// This is the building block for dependency graphs between tasks.
+// The continuations only share the collected values, not the futures,
+// so a future that never completes doesn't keep the others alive.
+template <typename T>
+auto whenAll(const std::vector<Future<T>>& futures)
+{
+    using R = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+
+    Promise<R> promise;
+
+    if (futures.empty()) {
+        if constexpr (std::is_void_v<T>)
+            promise.setValue();
+        else
+            promise.setValue(R{});
+
+        return promise.future();
+    }
+
+    auto remaining = std::make_shared<std::atomic<std::size_t>>(futures.size());
+    auto values = std::make_shared<std::vector<std::optional<detail::StoredType<T>>>>(futures.size());
+
+    for (std::size_t index = 0; index < futures.size(); ++index) {
+        futures.at(index)
+            .then(runInline, [promise, values, remaining, index](const auto&... value) {
+                // Every index is written once, before its decrement
+                values->at(index).emplace(value...);
+
+                if (--(*remaining) != 0)
+                    return;
+
+                if constexpr (std::is_void_v<T>) {
+                    promise.setValue();
+                }
+                else {
+                    R results;
+                    results.reserve(values->size());
+
+                    for (std::optional<T>& result : *values)
+                        results.push_back(std::move(*result));
+
+                    promise.setValue(std::move(results));
+                }
+            })
+            .onFailure(runInline, [promise](const std::exception_ptr& exception) {
+                promise.setException(exception);
+            });
+    }
+
+    return promise.future();
+}
+
+} // namespace Slicer
+
+#endif // FUTURE_HPP
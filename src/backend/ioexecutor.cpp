@@ -0,0 +1,75 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ioexecutor.hpp"
+
+namespace Slicer {
+
+thread_local bool IoExecutor::s_isIoThread = false;
+
+IoExecutor::IoExecutor()
+    : m_threadpool{defaultConcurrency()}
+{
+}
+
+IoExecutor::~IoExecutor()
+{
+    m_threadpool.wait();
+}
+
+IoExecutor& IoExecutor::instance()
+{
+    static IoExecutor executor;
+
+    return executor;
+}
+
+void IoExecutor::setMaxConcurrency(int maxConcurrency)
+{
+    if (maxConcurrency < 1)
+        throw std::runtime_error("The I/O executor needs at least one thread");
+
+    m_threadpool.resize(maxConcurrency);
+}
+
+int IoExecutor::maxConcurrency() const
+{
+    return m_threadpool.pool_size();
+}
+
+void IoExecutor::waitUntilAllTasksFinish()
+{
+    m_threadpool.wait();
+}
+
+bool IoExecutor::isIoThread()
+{
+    return s_isIoThread;
+}
+
+int IoExecutor::defaultConcurrency()
+{
+    // I/O bound work doesn't benefit from many threads,
+    // but a few of them let independent files overlap
+    const unsigned int numberOfCores = std::thread::hardware_concurrency();
+
+    if (numberOfCores >= 4)
+        return 4;
+
+    return 2;
+}
+
+} // namespace Slicer
@@ -0,0 +1,108 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef IOEXECUTOR_HPP
+#define IOEXECUTOR_HPP
+
+#include "parallelfor.hpp"
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <threadpool.hpp>
+
+namespace Slicer {
+
+// Runs blocking file operations (copying, parsing, writing) on a small
+// dedicated pool, so that a slow disk never starves the render workers.
+// CPU-bound work goes to the CpuExecutor instead.
+class IoExecutor {
+public:
+    IoExecutor(const IoExecutor&) = delete;
+    IoExecutor& operator=(const IoExecutor&) = delete;
+    IoExecutor(IoExecutor&&) = delete;
+    IoExecutor& operator=(IoExecutor&& src) = delete;
+
+    ~IoExecutor();
+
+    static IoExecutor& instance();
+
+    template <typename F>
+    [[nodiscard]] std::future<std::invoke_result_t<F>> submit(F&& function);
+
+    // Runs a blocking file operation in the calling thread.
+    // A caller that waits for the result gains nothing from a pool thread,
+    // and would otherwise queue behind whatever background work
+    // (a save, a warm-up) is already running there.
+    template <typename F>
+    std::invoke_result_t<F> run(F&& function);
+
+    // Calls the function for every index in [0, count), spreading the calls
+    // across the pool. The calling thread takes part in the work, so this is
+    // safe to use from an I/O thread too. Rethrows the first exception.
+    template <typename F>
+    void parallelFor(std::size_t count, F function);
+
+    void setMaxConcurrency(int maxConcurrency);
+    [[nodiscard]] int maxConcurrency() const;
+    void waitUntilAllTasksFinish();
+
+    [[nodiscard]] static bool isIoThread();
+
+private:
+    IoExecutor();
+
+    static int defaultConcurrency();
+    static thread_local bool s_isIoThread;
+
+    astp::ThreadPool m_threadpool;
+};
+
+template <typename F>
+std::future<std::invoke_result_t<F>> IoExecutor::submit(F&& function)
+{
+    using Result = std::invoke_result_t<F>;
+
+    // The pool only accepts copyable jobs, hence the shared_ptr
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(function));
+    std::future<Result> future = task->get_future();
+
+    m_threadpool.push([task]() {
+        s_isIoThread = true;
+        (*task)();
+    });
+
+    return future;
+}
+
+template <typename F>
+std::invoke_result_t<F> IoExecutor::run(F&& function)
+{
+    return function();
+}
+
+template <typename F>
+void IoExecutor::parallelFor(std::size_t count, F function)
+{
+    detail::parallelFor(m_threadpool,
+                        static_cast<std::size_t>(maxConcurrency()),
+                        count,
+                        std::move(function),
+                        []() { s_isIoThread = true; });
+}
+
+} // namespace Slicer
+
+#endif // IOEXECUTOR_HPP
@@ -19,11 +19,13 @@
 
 namespace Slicer {
 
-Page::Page(std::unique_ptr<poppler::page> ppage,
+Page::Page(std::shared_ptr<poppler::document> pdocument,
+           std::unique_ptr<poppler::page> ppage,
            const Glib::ustring& fileName,
            unsigned int fileNumber,
            unsigned int pageNumber)
     : m_fileNumber{fileNumber}
+    , m_pdocument{std::move(pdocument)}
     , m_ppage{std::move(ppage)}
     , m_fileName{fileName}
     , m_indexInFile{pageNumber}
@@ -128,6 +130,11 @@ void Page::rotateLeft()
         m_currentRotation -= 90;
 }
 
+void Page::rotate(int quarterTurns)
+{
+    m_currentRotation = ((m_currentRotation + quarterTurns * 90) % 360 + 360) % 360;
+}
+
 int Page::sortFunction(const Page& a, const Page& b)
 {
     const unsigned int aPosition = a.getDocumentIndex();
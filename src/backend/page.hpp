@@ -19,6 +19,8 @@
 
 #include <glibmm/object.h>
 #include <gdkmm/pixbuf.h>
+#include <memory>
+#include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
 
 namespace Slicer {
@@ -30,7 +32,8 @@ public:
         int height;
     };
 
-    Page(std::unique_ptr<poppler::page> ppage,
+    Page(std::shared_ptr<poppler::document> pdocument,
+         std::unique_ptr<poppler::page> ppage,
          const Glib::ustring& fileName,
          unsigned int fileNumber,
          unsigned int pageNumber);
@@ -48,6 +51,7 @@ public:
     void setDocumentIndex(unsigned int newIndex);
     void rotateRight();
     void rotateLeft();
+    void rotate(int quarterTurns);
 
     sigc::signal<void> indexChanged;
     const unsigned int m_fileNumber;
@@ -57,6 +61,9 @@ public:
                             const Glib::RefPtr<const Page>& b);
 
 private:
+    // A poppler page can't outlive its document, so every page keeps it
+    // alive. The document goes away along with the last of its pages.
+    std::shared_ptr<poppler::document> m_pdocument;
     std::unique_ptr<poppler::page> m_ppage;
     const Glib::ustring m_fileName;
     const unsigned int m_indexInFile;
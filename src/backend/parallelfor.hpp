@@ -0,0 +1,98 @@
+// PDF Slicer
+// Copyright (C) 2019 Julián Unrrein
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PARALLELFOR_HPP
+#define PARALLELFOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <threadpool.hpp>
+
+namespace Slicer::detail {
+
+// Shared by the executors. Calls the function for every index in
+// [0, count), on the calling thread and on up to numberOfThreads - 1
+// helpers of the pool. Every helper calls onHelperStart() first.
+template <typename F, typename G>
+void parallelFor(astp::ThreadPool& threadpool,
+                 std::size_t numberOfThreads,
+                 std::size_t count,
+                 F function,
+                 G onHelperStart)
+{
+    if (count == 0)
+        return;
+
+    struct State {
+        std::atomic<std::size_t> nextIndex{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::size_t finished = 0;
+        std::exception_ptr exception;
+    };
+
+    auto state = std::make_shared<State>();
+
+    auto work = [state, count, function]() mutable {
+        for (std::size_t i = state->nextIndex++; i < count; i = state->nextIndex++) {
+            std::exception_ptr exception;
+
+            try {
+                function(i);
+            }
+            catch (...) {
+                exception = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{state->mutex};
+
+                if (state->exception == nullptr)
+                    state->exception = exception;
+
+                ++state->finished;
+            }
+
+            state->condition.notify_all();
+        }
+    };
+
+    const std::size_t numberOfHelpers = std::min(count, std::max<std::size_t>(numberOfThreads, 1)) - 1;
+
+    for (std::size_t i = 0; i < numberOfHelpers; ++i)
+        threadpool.push([work, onHelperStart]() mutable {
+            onHelperStart();
+            work();
+        });
+
+    // The caller takes part too, so the loop finishes even when
+    // every thread of the pool is busy
+    work();
+
+    std::unique_lock<std::mutex> lock{state->mutex};
+    state->condition.wait(lock, [&state, count]() { return state->finished == count; });
+
+    if (state->exception != nullptr)
+        std::rethrow_exception(state->exception);
+}
+
+} // namespace Slicer::detail
+
+#endif // PARALLELFOR_HPP
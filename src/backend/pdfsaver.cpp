@@ -1,42 +1,1719 @@
 #include "pdfsaver.hpp"
+#include "cpuexecutor.hpp"
+#include "future.hpp"
+#include "ioexecutor.hpp"
 #include "tempfile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <glibmm/checksum.h>
+#include <list>
+#include <map>
+#include <qpdf/Pl_Buffer.hh>
+#include <qpdf/Pl_DCT.hh>
+#include <qpdf/Pl_Flate.hh>
+#include <qpdf/Pl_StdioFile.hh>
 #include <qpdf/QPDFWriter.hh>
+#include <qpdf/QUtil.hh>
 #include <range/v3/view/iota.hpp>
 #include <range/v3/view/set_algorithm.hpp>
+#include <set>
+#include <shared_mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace Slicer {
 
-PdfSaver::PdfSaver(const SaveData& saveData)
-    : m_saveData{saveData}
+// zlib levels, as understood by Pl_Flate
+static const int defaultCompressionLevel = -1;
+static const int maximumCompressionLevel = 9;
+
+// Below this fraction of the first file, the output is built from scratch
+// instead of from the shell of that file
+static const std::size_t subsetRatio = 4;
+
+// Entries of the catalog of the first file that outputs built from
+// scratch keep. Actions are left out, as they may point anywhere. The
+// form only keeps the fields of the kept pages. The structure tree is
+// kept whole: the elements of the pages left out just lose their page.
+static const std::vector<std::string> copiedCatalogKeys = {"/AcroForm",
+                                                           "/Lang",
+                                                           "/MarkInfo",
+                                                           "/Metadata",
+                                                           "/Names",
+                                                           "/OCProperties",
+                                                           "/Outlines",
+                                                           "/PageLabels",
+                                                           "/PageLayout",
+                                                           "/PageMode",
+                                                           "/StructTreeRoot",
+                                                           "/ViewerPreferences"};
+
+// Streamed merges keep at most this many inputs open at once.
+// Saves with more inputs than this are always streamed.
+static const std::size_t streamingChunkSize = 64;
+
+// Images only slightly over the resolution aren't worth a resample
+static const double minimumResampleRatio = 0.75;
+
+// Rough write speeds used by estimates, in bytes per second
+static const std::size_t fastThroughput = 200 * 1024 * 1024;
+static const std::size_t balancedThroughput = 100 * 1024 * 1024;
+static const std::size_t compactThroughput = 20 * 1024 * 1024;
+static const std::size_t copyThroughput = 500 * 1024 * 1024;
+
+// What estimates add for each page besides its streams: the page
+// dictionary, its resources and the cross-reference entries
+static const std::size_t estimatedPageOverhead = 1024;
+
+// How much estimates expect unfiltered streams to shrink once compressed
+static const std::size_t estimatedCompressionRatio = 3;
+
+// Part of the names of cached outputs. Bump it whenever the same pages
+// and options make a different output, so older outputs aren't used.
+static const int cacheFormatVersion = 1;
+
+// Limits how much decoded stream data is held in memory while recompressing
+static const std::size_t recompressionBatchSize = 64 * 1024 * 1024;
+
+static PointerHolder<Buffer> deflate(Buffer& data)
+{
+    Pl_Buffer compressed{"compressed stream"};
+    Pl_Flate flate{"deflate", &compressed, Pl_Flate::a_deflate};
+    flate.write(data.getBuffer(), data.getSize());
+    flate.finish();
+
+    return PointerHolder<Buffer>{compressed.getBuffer()};
+}
+
+static void syncFile(FILE* file)
+{
+#ifdef _WIN32
+    const bool synced = fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+    const bool synced = fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+
+    if (!synced)
+        throw std::runtime_error("The output file could not be synced to disk");
+}
+
+// Pipes and terminals can't be synced, and don't need to be
+static void syncDescriptor(int fileDescriptor)
+{
+#ifdef _WIN32
+    const bool synced = _commit(fileDescriptor) == 0 || errno == EBADF;
+#else
+    const bool synced = fsync(fileDescriptor) == 0 || errno == EINVAL || errno == EROFS;
+#endif
+
+    if (!synced)
+        throw std::runtime_error("The output could not be synced to disk");
+}
+
+static std::chrono::milliseconds writeDuration(std::size_t bytes, std::size_t throughput)
+{
+    return std::chrono::milliseconds{static_cast<std::chrono::milliseconds::rep>(bytes * 1000.0 / throughput)};
+}
+
+static void throwIfCanceled(const PdfSaver::SaveOptions& options)
+{
+    if (options.isCanceled && options.isCanceled())
+        throw TaskCanceled{};
+}
+
+// GIO clones the file instead of copying its data, where the filesystem
+// supports it. Otherwise the copy stops as soon as the save is canceled.
+static void copyFile(const Glib::RefPtr<Gio::File>& sourceFile,
+                     const Glib::RefPtr<Gio::File>& destinationFile,
+                     const PdfSaver::SaveOptions& options)
+{
+    Glib::RefPtr<Gio::Cancellable> cancellable = Gio::Cancellable::create();
+
+    try {
+        sourceFile->copy(destinationFile,
+                         [&options, &cancellable](goffset, goffset) {
+                             if (options.isCanceled && options.isCanceled())
+                                 cancellable->cancel();
+                         },
+                         cancellable,
+                         Gio::FILE_COPY_OVERWRITE);
+    }
+    catch (const Gio::Error& error) {
+        if (error.code() == Gio::Error::CANCELLED)
+            throw TaskCanceled{};
+
+        throw;
+    }
+
+    throwIfCanceled(options);
+}
+
+// Sits in front of the output to count the written bytes,
+// and to stop the writer as soon as the save is canceled
+class ProgressPipeline : public Pipeline {
+public:
+    ProgressPipeline(Pipeline* next, const PdfSaver::SaveOptions& options)
+        : Pipeline{"progress", next}
+        , m_options{options}
+    {
+    }
+
+    void write(unsigned char* data, size_t length) override
+    {
+        throwIfCanceled(m_options);
+
+        getNext()->write(data, length);
+        m_bytesWritten += length;
+    }
+
+    void finish() override { getNext()->finish(); }
+
+    std::size_t bytesWritten() const { return m_bytesWritten; }
+
+private:
+    const PdfSaver::SaveOptions& m_options;
+    std::size_t m_bytesWritten = 0;
+};
+
+class VectorPipeline : public Pipeline {
+public:
+    VectorPipeline(std::vector<unsigned char>& buffer)
+        : Pipeline{"memory buffer", nullptr}
+        , m_buffer{buffer}
+    {
+    }
+
+    void write(unsigned char* data, size_t length) override
+    {
+        m_buffer.insert(m_buffer.end(), data, data + length);
+    }
+
+    void finish() override {}
+
+private:
+    std::vector<unsigned char>& m_buffer;
+};
+
+class DescriptorPipeline : public Pipeline {
+public:
+    DescriptorPipeline(int fileDescriptor)
+        : Pipeline{"file descriptor", nullptr}
+        , m_fileDescriptor{fileDescriptor}
+    {
+    }
+
+    // Pipes may take less than what's given to them in a single write
+    void write(unsigned char* data, size_t length) override
+    {
+        while (length > 0) {
+#ifdef _WIN32
+            const auto written = _write(m_fileDescriptor, data, static_cast<unsigned int>(length));
+#else
+            const auto written = ::write(m_fileDescriptor, data, length);
+#endif
+
+            if (written < 0 && errno == EINTR)
+                continue;
+
+            if (written < 0)
+                throw std::runtime_error("The output could not be written");
+
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+    }
+
+    void finish() override {}
+
+private:
+    int m_fileDescriptor;
+};
+
+class SaveProgressReporter : public QPDFWriter::ProgressReporter {
+public:
+    SaveProgressReporter(const ProgressPipeline& pipeline, const PdfSaver::SaveOptions& options)
+        : m_pipeline{pipeline}
+        , m_options{options}
+    {
+    }
+
+    void reportProgress(int percentage) override
+    {
+        m_options.onProgress(PdfSaver::SaveProgress{percentage, m_pipeline.bytesWritten()});
+    }
+
+private:
+    const ProgressPipeline& m_pipeline;
+    const PdfSaver::SaveOptions& m_options;
+};
+
+// Pl_Flate has a single compression level for the whole process.
+// Saves at the default level share it, while a compact save takes it
+// for itself until its output is written.
+class CompressionLevelLock {
+public:
+    CompressionLevelLock(PdfSaver::SaveProfile profile)
+        : m_isMaximum{profile == PdfSaver::SaveProfile::Compact}
+    {
+        if (m_isMaximum) {
+            mutex().lock();
+            Pl_Flate::setCompressionLevel(maximumCompressionLevel);
+        }
+        else {
+            mutex().lock_shared();
+        }
+    }
+
+    CompressionLevelLock(const CompressionLevelLock&) = delete;
+    CompressionLevelLock& operator=(const CompressionLevelLock&) = delete;
+    CompressionLevelLock(CompressionLevelLock&&) = delete;
+    CompressionLevelLock& operator=(CompressionLevelLock&& src) = delete;
+
+    ~CompressionLevelLock()
+    {
+        if (m_isMaximum) {
+            Pl_Flate::setCompressionLevel(defaultCompressionLevel);
+            mutex().unlock();
+        }
+        else {
+            mutex().unlock_shared();
+        }
+    }
+
+private:
+    const bool m_isMaximum;
+
+    static std::shared_mutex& mutex()
+    {
+        static std::shared_mutex compressionLevelMutex;
+
+        return compressionLevelMutex;
+    }
+};
+
+// Hashes the data written to it, so streams can be told apart
+// without holding a copy of their data
+class HashPipeline : public Pipeline {
+public:
+    HashPipeline()
+        : Pipeline{"hash", nullptr}
+        , m_checksum{Glib::Checksum::CHECKSUM_MD5}
+    {
+    }
+
+    void write(unsigned char* data, size_t length) override
+    {
+        m_checksum.update(data, static_cast<gssize>(length));
+        m_size += length;
+    }
+
+    void finish() override {}
+
+    std::string digest() const { return m_checksum.get_string(); }
+    std::size_t size() const { return m_size; }
+
+private:
+    Glib::Checksum m_checksum;
+    std::size_t m_size = 0;
+};
+
+// The dictionary of a stream, leaving out its length,
+// which may be an indirect object of its own
+static std::string dictionaryOf(QPDFObjectHandle stream)
+{
+    QPDFObjectHandle dictionary = stream.getDict().shallowCopy();
+    dictionary.removeKey("/Length");
+
+    return dictionary.unparse();
+}
+
+static bool haveSameData(QPDFObjectHandle stream, QPDFObjectHandle otherStream)
+{
+    PointerHolder<Buffer> data = stream.getRawStreamData();
+    PointerHolder<Buffer> otherData = otherStream.getRawStreamData();
+
+    return data->getSize() == otherData->getSize()
+           && std::equal(data->getBuffer(), data->getBuffer() + data->getSize(), otherData->getBuffer());
+}
+
+// Makes everything reachable from the trailer point to the replacement
+// of an object instead of to the object itself
+static void replaceReferences(QPDF& pdf, const std::map<QPDFObjGen, QPDFObjectHandle>& replacements)
+{
+    std::set<QPDFObjGen> visited;
+    std::vector<QPDFObjectHandle> pending{pdf.getTrailer()};
+
+    auto replacementOf = [&replacements](const QPDFObjectHandle& object) {
+        if (!object.isIndirect())
+            return object;
+
+        const auto it = replacements.find(object.getObjGen());
+
+        return it != replacements.end() ? it->second : object;
+    };
+
+    while (!pending.empty()) {
+        QPDFObjectHandle object = pending.back();
+        pending.pop_back();
+
+        if (object.isIndirect() && !visited.insert(object.getObjGen()).second)
+            continue;
+
+        if (object.isStream()) {
+            pending.push_back(object.getDict());
+        }
+        else if (object.isArray()) {
+            for (int i = 0; i < object.getArrayNItems(); ++i) {
+                QPDFObjectHandle item = object.getArrayItem(i);
+                QPDFObjectHandle replacement = replacementOf(item);
+
+                if (!(replacement.getObjGen() == item.getObjGen()))
+                    object.setArrayItem(i, replacement);
+
+                pending.push_back(replacement);
+            }
+        }
+        else if (object.isDictionary()) {
+            for (const std::string& key : object.getKeys()) {
+                QPDFObjectHandle item = object.getKey(key);
+                QPDFObjectHandle replacement = replacementOf(item);
+
+                if (!(replacement.getObjGen() == item.getObjGen()))
+                    object.replaceKey(key, replacement);
+
+                pending.push_back(replacement);
+            }
+        }
+    }
+}
+
+// Skips what was already visited, so a walk can continue where
+// a previous one left off
+static std::vector<QPDFObjectHandle> reachableStreams(QPDFObjectHandle root, std::set<QPDFObjGen>& visited)
+{
+    std::vector<QPDFObjectHandle> result;
+    std::vector<QPDFObjectHandle> pending{root};
+
+    while (!pending.empty()) {
+        QPDFObjectHandle object = pending.back();
+        pending.pop_back();
+
+        if (object.isIndirect() && !visited.insert(object.getObjGen()).second)
+            continue;
+
+        if (object.isStream()) {
+            result.push_back(object);
+            pending.push_back(object.getDict());
+        }
+        else if (object.isArray()) {
+            for (int i = 0; i < object.getArrayNItems(); ++i)
+                pending.push_back(object.getArrayItem(i));
+        }
+        else if (object.isDictionary()) {
+            for (const std::string& key : object.getKeys())
+                pending.push_back(object.getKey(key));
+        }
+    }
+
+    return result;
+}
+
+// Only what's reachable from the trailer ends up in the output
+static std::vector<QPDFObjectHandle> reachableStreams(QPDF& pdf)
+{
+    std::set<QPDFObjGen> visited;
+
+    return reachableStreams(pdf.getTrailer(), visited);
+}
+
+// Walks down the page tree following the page counts, instead of listing
+// every page. The counts met on the way have to add up, and no node may
+// be met twice or have another parent. Returns null otherwise, so the
+// caller falls back to the full walk of QPDF, which repairs the tree.
+static QPDFObjectHandle findPage(QPDF& pdf, unsigned int pageNumber)
+{
+    QPDFObjectHandle node = pdf.getRoot().getKey("/Pages");
+    long long remaining = pageNumber;
+    std::set<QPDFObjGen> visited;
+
+    while (node.isDictionary() && node.getKey("/Kids").isArray()) {
+        if (!visited.insert(node.getObjGen()).second || !node.getKey("/Count").isInteger())
+            return QPDFObjectHandle::newNull();
+
+        QPDFObjectHandle kids = node.getKey("/Kids");
+        QPDFObjectHandle next = QPDFObjectHandle::newNull();
+        bool isFound = false;
+        long long total = 0;
+
+        for (int i = 0; i < kids.getArrayNItems(); ++i) {
+            QPDFObjectHandle kid = kids.getArrayItem(i);
+            long long count = 1;
+
+            if (kid.isDictionary() && kid.getKey("/Kids").isArray()) {
+                if (!kid.getKey("/Count").isInteger())
+                    return QPDFObjectHandle::newNull();
+
+                count = kid.getKey("/Count").getIntValue();
+            }
+
+            if (count < 0)
+                return QPDFObjectHandle::newNull();
+
+            if (!isFound && remaining < count) {
+                next = kid;
+                isFound = true;
+            }
+            else if (!isFound) {
+                remaining -= count;
+            }
+
+            total += count;
+        }
+
+        if (!next.isDictionary() || total != node.getKey("/Count").getIntValue()
+            || !(next.getKey("/Parent").getObjGen() == node.getObjGen()))
+            return QPDFObjectHandle::newNull();
+
+        node = next;
+    }
+
+    QPDFObjectHandle type = node.isDictionary() ? node.getKey("/Type") : QPDFObjectHandle::newNull();
+
+    return remaining == 0 && type.isName() && type.getName() == "/Page" ? node : QPDFObjectHandle::newNull();
+}
+
+// Same as QPDFPageDocumentHelper::pushInheritedAttributesToPage(),
+// but for a single page
+static void pushInheritedAttributes(QPDFObjectHandle page)
+{
+    for (const std::string key : {"/Resources", "/MediaBox", "/CropBox", "/Rotate"}) {
+        if (page.hasKey(key))
+            continue;
+
+        std::set<QPDFObjGen> visited;
+
+        for (QPDFObjectHandle node = page.getKey("/Parent");
+             node.isDictionary() && visited.insert(node.getObjGen()).second;
+             node = node.getKey("/Parent")) {
+            if (node.hasKey(key)) {
+                QPDFObjectHandle value = node.getKey(key);
+                page.replaceKey(key, value.isIndirect() ? value : value.shallowCopy());
+                break;
+            }
+        }
+    }
+}
+
+static int rotationOf(QPDFObjectHandle page)
+{
+    std::set<QPDFObjGen> visited;
+
+    for (QPDFObjectHandle node = page;
+         node.isDictionary() && visited.insert(node.getObjGen()).second;
+         node = node.getKey("/Parent")) {
+        if (node.getKey("/Rotate").isInteger())
+            return ((node.getKey("/Rotate").getIntValue() % 360) + 360) % 360;
+    }
+
+    return 0;
+}
+
+// Makes a page a direct kid of the root of the page tree.
+// Returns whether its dictionary changed.
+static bool updatePage(QPDFObjectHandle page, QPDFObjectHandle pages, int rotation)
+{
+    bool isChanged = false;
+
+    if (!(page.getKey("/Parent").getObjGen() == pages.getObjGen())) {
+        pushInheritedAttributes(page);
+        page.replaceKey("/Parent", pages);
+        isChanged = true;
+    }
+
+    if (rotationOf(page) != ((rotation % 360) + 360) % 360) {
+        QPDFPageObjectHelper{page}.rotatePage(rotation, false);
+        isChanged = true;
+    }
+
+    return isChanged;
+}
+
+// The offset of the last cross-reference table of a file, or -1 when
+// the file ends with a cross-reference stream, which an appended table
+// can't follow
+static qpdf_offset_t lastXrefTableOffset(FILE* file)
+{
+    static const qpdf_offset_t tailSize = 1024;
+
+    QUtil::seek(file, 0, SEEK_END);
+    const qpdf_offset_t fileSize = QUtil::tell(file);
+    const qpdf_offset_t tailOffset = std::max<qpdf_offset_t>(0, fileSize - tailSize);
+
+    std::string tail(static_cast<std::size_t>(fileSize - tailOffset), '\0');
+    QUtil::seek(file, tailOffset, SEEK_SET);
+
+    if (fread(&tail[0], 1, tail.size(), file) != tail.size())
+        return -1;
+
+    const std::size_t keyword = tail.rfind("startxref");
+
+    if (keyword == std::string::npos)
+        return -1;
+
+    const qpdf_offset_t offset = std::strtoll(tail.c_str() + keyword + 9, nullptr, 10);
+
+    if (offset <= 0 || offset >= fileSize)
+        return -1;
+
+    char xref[4];
+    QUtil::seek(file, offset, SEEK_SET);
+
+    if (fread(xref, 1, sizeof(xref), file) != sizeof(xref) || std::string(xref, sizeof(xref)) != "xref")
+        return -1;
+
+    return offset;
+}
+
+// The number of color components of an image that can be resampled,
+// or 0 when it can't: only 8 bit gray and RGB images are, and not when
+// they have color key masks or decode arrays, which resampling breaks
+static int resampledComponents(QPDFObjectHandle image)
+{
+    QPDFObjectHandle dictionary = image.getDict();
+    QPDFObjectHandle bitsPerComponent = dictionary.getKey("/BitsPerComponent");
+    QPDFObjectHandle colorSpace = dictionary.getKey("/ColorSpace");
+
+    if (!bitsPerComponent.isInteger() || bitsPerComponent.getIntValue() != 8
+        || !dictionary.getKey("/Width").isInteger() || !dictionary.getKey("/Height").isInteger()
+        || dictionary.hasKey("/Mask") || dictionary.hasKey("/Decode")
+        || dictionary.getKey("/ImageMask").isBool())
+        return 0;
+
+    if (colorSpace.isName() && colorSpace.getName() == "/DeviceGray")
+        return 1;
+
+    if (colorSpace.isName() && colorSpace.getName() == "/DeviceRGB")
+        return 3;
+
+    return 0;
+}
+
+// The longest side of a page, in inches. Images are assumed to be drawn
+// over the whole page at most, so they're never resampled below what
+// they're shown at. Returns 0 when the page has no usable media box.
+static double pageSide(QPDFObjectHandle page)
+{
+    QPDFObjectHandle mediaBox = page.getKey("/MediaBox");
+
+    if (!mediaBox.isArray() || mediaBox.getArrayNItems() != 4)
+        return 0;
+
+    for (int i = 0; i < 4; ++i)
+        if (!mediaBox.getArrayItem(i).isNumber())
+            return 0;
+
+    const double width = std::abs(mediaBox.getArrayItem(2).getNumericValue()
+                                  - mediaBox.getArrayItem(0).getNumericValue());
+    const double height = std::abs(mediaBox.getArrayItem(3).getNumericValue()
+                                   - mediaBox.getArrayItem(1).getNumericValue());
+
+    return std::max(width, height) / 72;
+}
+
+// Keeps the biggest page side each image is drawn on,
+// going into the forms a page draws as well
+static void collectImages(QPDFObjectHandle resources,
+                          double side,
+                          std::map<QPDFObjGen, std::pair<QPDFObjectHandle, double>>& images,
+                          std::set<QPDFObjGen>& visitedForms)
+{
+    QPDFObjectHandle xObjects = resources.isDictionary() ? resources.getKey("/XObject")
+                                                         : QPDFObjectHandle::newNull();
+
+    if (!xObjects.isDictionary())
+        return;
+
+    for (const std::string& key : xObjects.getKeys()) {
+        QPDFObjectHandle xObject = xObjects.getKey(key);
+
+        if (!xObject.isStream() || !xObject.isIndirect())
+            continue;
+
+        QPDFObjectHandle subtype = xObject.getDict().getKey("/Subtype");
+
+        if (subtype.isName() && subtype.getName() == "/Image") {
+            auto [it, isNew] = images.emplace(xObject.getObjGen(), std::make_pair(xObject, side));
+
+            if (!isNew)
+                it->second.second = std::max(it->second.second, side);
+        }
+        else if (subtype.isName() && subtype.getName() == "/Form"
+                 && visitedForms.insert(xObject.getObjGen()).second) {
+            collectImages(xObject.getDict().getKey("/Resources"), side, images, visitedForms);
+        }
+    }
+}
+
+// Averages the pixels each new pixel covers, or just picks one of them
+// when the result doesn't need to be smooth
+static PointerHolder<Buffer> resample(const Buffer& pixels,
+                                      int width,
+                                      int height,
+                                      int components,
+                                      int newWidth,
+                                      int newHeight,
+                                      bool isSmooth)
+{
+    PointerHolder<Buffer> result{new Buffer(static_cast<std::size_t>(newWidth) * newHeight * components)};
+    const unsigned char* source = pixels.getBuffer();
+    unsigned char* destination = result->getBuffer();
+
+    for (int y = 0; y < newHeight; ++y) {
+        const long long firstRow = static_cast<long long>(y) * height / newHeight;
+        const long long lastRow = isSmooth ? std::max(firstRow + 1, static_cast<long long>(y + 1) * height / newHeight)
+                                           : firstRow + 1;
+
+        for (int x = 0; x < newWidth; ++x) {
+            const long long firstColumn = static_cast<long long>(x) * width / newWidth;
+            const long long lastColumn = isSmooth ? std::max(firstColumn + 1, static_cast<long long>(x + 1) * width / newWidth)
+                                                  : firstColumn + 1;
+            const long long count = (lastRow - firstRow) * (lastColumn - firstColumn);
+
+            for (int component = 0; component < components; ++component) {
+                long long sum = 0;
+
+                for (long long row = firstRow; row < lastRow; ++row)
+                    for (long long column = firstColumn; column < lastColumn; ++column)
+                        sum += source[(row * width + column) * components + component];
+
+                *destination++ = static_cast<unsigned char>(sum / count);
+            }
+        }
+    }
+
+    return result;
+}
+
+static PointerHolder<Buffer> encodeJpeg(Buffer& pixels, int width, int height, int components)
+{
+    Pl_Buffer encoded{"jpeg image"};
+    Pl_DCT encoder{"jpeg encoder",
+                   &encoded,
+                   static_cast<JDIMENSION>(width),
+                   static_cast<JDIMENSION>(height),
+                   components,
+                   components == 1 ? JCS_GRAYSCALE : JCS_RGB};
+    encoder.write(pixels.getBuffer(), pixels.getSize());
+    encoder.finish();
+
+    return PointerHolder<Buffer>{encoded.getBuffer()};
+}
+
+// Copies of streams from other files read their data from those files
+// when written. Reading it ahead of time leaves the copies on their own.
+static void materializeStreams(QPDF& pdf)
+{
+    for (QPDFObjectHandle& stream : reachableStreams(pdf)) {
+        QPDFObjectHandle dictionary = stream.getDict();
+        stream.replaceStreamData(stream.getRawStreamData(),
+                                 dictionary.getKey("/Filter"),
+                                 dictionary.getKey("/DecodeParms"));
+    }
+}
+
+// Direct objects can't go through QPDF::copyForeignObject(),
+// but the indirect objects inside them can
+static QPDFObjectHandle copyValue(QPDF& destinationPDF, QPDFObjectHandle value)
+{
+    if (value.isIndirect())
+        return value.getOwningQPDF() == &destinationPDF ? value : destinationPDF.copyForeignObject(value);
+
+    if (value.isArray()) {
+        QPDFObjectHandle result = QPDFObjectHandle::newArray();
+
+        for (int i = 0; i < value.getArrayNItems(); ++i)
+            result.appendItem(copyValue(destinationPDF, value.getArrayItem(i)));
+
+        return result;
+    }
+
+    if (value.isDictionary()) {
+        QPDFObjectHandle result = QPDFObjectHandle::newDictionary();
+
+        for (const std::string& key : value.getKeys())
+            result.replaceKey(key, copyValue(destinationPDF, value.getKey(key)));
+
+        return result;
+    }
+
+    return value.shallowCopy();
+}
+
+// Copies the page into the output, leaving the page in its own file as
+// it is, since the inputs of a session are shared by several saves.
+// The copy gets the attributes the page inherits and its new rotation.
+// QPDF::addPage() would push the inherited attributes of every page of
+// the input instead.
+static QPDFObjectHandle addPage(QPDF& destinationPDF,
+                                QPDFPageDocumentHelper& destinationPageDocumentHelper,
+                                const QPDFPageObjectHelper& page,
+                                int rotation)
+{
+    QPDFObjectHandle sourcePage = page.getObjectHandle();
+    QPDFObjectHandle pageObject = sourcePage;
+
+    if (sourcePage.getOwningQPDF() != &destinationPDF)
+        pageObject = destinationPDF.copyForeignObject(sourcePage);
+
+    for (const std::string key : {"/Resources", "/MediaBox", "/CropBox", "/Rotate"}) {
+        if (pageObject.hasKey(key))
+            continue;
+
+        std::set<QPDFObjGen> visited;
+
+        for (QPDFObjectHandle node = sourcePage.getKey("/Parent");
+             node.isDictionary() && visited.insert(node.getObjGen()).second;
+             node = node.getKey("/Parent")) {
+            if (node.hasKey(key)) {
+                pageObject.replaceKey(key, copyValue(destinationPDF, node.getKey(key)));
+                break;
+            }
+        }
+    }
+
+    QPDFPageObjectHelper pageObjectHelper{pageObject};
+    pageObjectHelper.rotatePage(rotation, false);
+    destinationPageDocumentHelper.addPage(pageObjectHelper, false);
+
+    return pageObject;
+}
+
+// Whether the field, or any field below it, is one of the annotations
+static bool hasWidgetAmong(QPDFObjectHandle field,
+                           const std::set<QPDFObjGen>& annotations,
+                           std::set<QPDFObjGen>& visited)
+{
+    if (!field.isDictionary())
+        return false;
+
+    if (field.isIndirect()) {
+        if (!visited.insert(field.getObjGen()).second)
+            return false;
+
+        if (annotations.count(field.getObjGen()) != 0)
+            return true;
+    }
+
+    QPDFObjectHandle kids = field.getKey("/Kids");
+
+    if (kids.isArray()) {
+        for (QPDFObjectHandle& kid : kids.getArrayAsVector()) {
+            if (hasWidgetAmong(kid, annotations, visited))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+// A copy of the form with only the fields that have a widget on one of
+// the pages, or null when none has. Otherwise the fields of the pages
+// left out would pull their widgets, and whatever those refer to, into
+// the output.
+static QPDFObjectHandle formOfPages(QPDFObjectHandle form, const std::vector<QPDFObjectHandle>& pages)
+{
+    std::set<QPDFObjGen> annotations;
+
+    for (QPDFObjectHandle page : pages) {
+        QPDFObjectHandle pageAnnotations = page.getKey("/Annots");
+
+        if (!pageAnnotations.isArray())
+            continue;
+
+        for (QPDFObjectHandle& annotation : pageAnnotations.getArrayAsVector()) {
+            if (annotation.isIndirect())
+                annotations.insert(annotation.getObjGen());
+        }
+    }
+
+    QPDFObjectHandle fields = QPDFObjectHandle::newArray();
+    QPDFObjectHandle allFields = form.getKey("/Fields");
+
+    if (allFields.isArray()) {
+        for (QPDFObjectHandle& field : allFields.getArrayAsVector()) {
+            std::set<QPDFObjGen> visited;
+
+            if (hasWidgetAmong(field, annotations, visited))
+                fields.appendItem(field);
+        }
+    }
+
+    if (fields.getArrayNItems() == 0)
+        return QPDFObjectHandle::newNull();
+
+    QPDFObjectHandle result = form.shallowCopy();
+    result.replaceKey("/Fields", fields);
+
+    return result;
+}
+
+// Copies the entries of the catalog of the first file that outputs built
+// from scratch would lose otherwise. Runs once the pages are copied: QPDF
+// then maps references to those pages to their copies, and references to
+// the pages that were left out to null, instead of pulling them into the
+// output. sourcePages are the pages of the first file that were copied.
+// Returns the copies.
+static std::vector<QPDFObjectHandle> copyCatalogEntries(QPDF& destinationPDF,
+                                                        QPDF& sourcePDF,
+                                                        const std::vector<QPDFObjectHandle>& sourcePages)
+{
+    std::vector<QPDFObjectHandle> result;
+    QPDFObjectHandle sourceRoot = sourcePDF.getRoot();
+
+    for (const std::string& key : copiedCatalogKeys) {
+        QPDFObjectHandle value = sourceRoot.getKey(key);
+
+        if (key == "/AcroForm" && value.isDictionary())
+            value = formOfPages(value, sourcePages);
+
+        if (value.isNull())
+            continue;
+
+        if (value.isArray() || value.isDictionary() || value.isStream()) {
+            // QPDF only stops at pages below the object it's asked
+            // to copy, which has to be indirect
+            if (!value.isIndirect())
+                value = sourcePDF.makeIndirectObject(value);
+
+            value = destinationPDF.copyForeignObject(value);
+        }
+        else {
+            value = value.shallowCopy();
+        }
+
+        destinationPDF.getRoot().replaceKey(key, value);
+        result.push_back(value);
+    }
+
+    return result;
+}
+
+// Holds the data of copied streams in a temporary file, so the inputs
+// they came from can be closed before the output is written
+class SpoolProvider : public QPDFObjectHandle::StreamDataProvider {
+public:
+    // The spool goes next to the output, which is where
+    // there's surely room for the data of the output
+    explicit SpoolProvider(const Glib::RefPtr<Gio::File>& output)
+        : m_spoolFile{output && !output->get_path().empty() ? TempFile::generateNextTo(output)
+                                                             : TempFile::generate()}
+        , m_file{QUtil::safe_fopen(m_spoolFile->get_path().c_str(), "w+b"), &fclose}
+    {
+    }
+
+    SpoolProvider(const SpoolProvider&) = delete;
+    SpoolProvider& operator=(const SpoolProvider&) = delete;
+    SpoolProvider(SpoolProvider&&) = delete;
+    SpoolProvider& operator=(SpoolProvider&& src) = delete;
+
+    ~SpoolProvider() override
+    {
+        m_file.reset();
+        std::remove(m_spoolFile->get_path().c_str());
+    }
+
+    void spool(QPDFObjectHandle stream)
+    {
+        PointerHolder<Buffer> data = stream.getRawStreamData();
+
+        QUtil::seek(m_file.get(), 0, SEEK_END);
+        const qpdf_offset_t offset = QUtil::tell(m_file.get());
+
+        if (fwrite(data->getBuffer(), 1, data->getSize(), m_file.get()) != data->getSize())
+            throw std::runtime_error("The spooled stream data could not be written");
+
+        m_ranges[stream.getObjGen()] = Range{offset, data->getSize()};
+    }
+
+    void provideStreamData(int objid, int generation, Pipeline* pipeline) override
+    {
+        const Range& range = m_ranges.at(QPDFObjGen{objid, generation});
+        std::vector<unsigned char> chunk(std::min(range.length, spoolReadSize));
+        std::size_t remaining = range.length;
+
+        QUtil::seek(m_file.get(), range.offset, SEEK_SET);
+
+        while (remaining > 0) {
+            const std::size_t length = std::min(remaining, chunk.size());
+
+            if (fread(chunk.data(), 1, length, m_file.get()) != length)
+                throw std::runtime_error("The spooled stream data could not be read");
+
+            pipeline->write(chunk.data(), length);
+            remaining -= length;
+        }
+
+        pipeline->finish();
+    }
+
+private:
+    struct Range {
+        qpdf_offset_t offset;
+        std::size_t length;
+    };
+
+    static constexpr std::size_t spoolReadSize = 64 * 1024;
+
+    Glib::RefPtr<Gio::File> m_spoolFile;
+    std::unique_ptr<FILE, decltype(&fclose)> m_file;
+    std::map<QPDFObjGen, Range> m_ranges;
+};
+
+PdfSaver::PdfSaver(const SaveData& saveData)
+    : m_saveData{saveData}
+    , m_session{m_saveData.session != nullptr ? m_saveData.session : std::make_shared<Session>()}
+{
+}
+
+// Inputs are parsed when saving, since streamed merges never hold
+// all of them at once
+void PdfSaver::parseInputs()
+{
+    if (!m_filesData.empty())
+        return;
+
+    keepOnlyReferencedInputs();
+
+    const std::vector<bool> isReferenced = referencedFiles();
+    m_filesData.resize(m_saveData.files.size());
+
+    // Every input has its own QPDF instance, so they can be parsed
+    // concurrently. Writing the output stays single-threaded.
+    // Files without pages in the output aren't needed, except
+    // for the first one, which the output is built from.
+    IoExecutor::instance().parallelFor(m_saveData.files.size(), [this, &isReferenced](std::size_t i) {
+        const Glib::RefPtr<Gio::File>& file = m_saveData.files.at(i);
+
+        if (i == 0)
+            m_filesData.at(i) = m_session->takeDestination(file);
+        else if (isReferenced.at(i))
+            m_filesData.at(i) = m_session->input(file);
+    });
+}
+
+std::vector<bool> PdfSaver::referencedFiles() const
+{
+    std::vector<bool> result(m_saveData.files.size(), false);
+
+    for (const PageData& page : m_saveData.pages)
+        result.at(page.file) = true;
+
+    return result;
+}
+
+void PdfSaver::keepOnlyReferencedInputs() const
+{
+    const std::vector<bool> isReferenced = referencedFiles();
+    std::set<std::string> paths;
+
+    for (std::size_t i = 0; i < m_saveData.files.size(); ++i)
+        if (isReferenced.at(i))
+            paths.insert(m_saveData.files.at(i)->get_path());
+
+    m_session->keepOnlyInputs(paths);
+}
+
+void PdfSaver::warmUp()
+{
+    if (m_saveData.files.empty())
+        return;
+
+    // A save using the session parses what it needs by itself,
+    // and warms up the next one when it's done
+    const std::unique_lock<std::recursive_mutex> sessionLock{m_session->m_userMutex, std::try_to_lock};
+
+    if (!sessionLock.owns_lock())
+        return;
+
+    keepOnlyReferencedInputs();
+
+    bool needsSpareDestination = false;
+
+    {
+        std::lock_guard<std::mutex> lock{m_session->m_mutex};
+
+        if (m_session->m_spareDestination == nullptr && !m_session->m_isParsingSpareDestination) {
+            needsSpareDestination = true;
+            m_session->m_isParsingSpareDestination = true;
+        }
+    }
+
+    // A file that can't be parsed here will fail again when saving,
+    // which is where the error gets reported. Inputs of streamed merges
+    // aren't kept open, so they aren't warmed up either.
+    if (!isStreamed(SaveOptions{})) {
+        const std::vector<bool> isReferenced = referencedFiles();
+
+        for (std::size_t i = 1; i < m_saveData.files.size(); ++i) {
+            try {
+                if (isReferenced.at(i))
+                    m_session->input(m_saveData.files.at(i));
+            }
+            catch (...) {
+            }
+        }
+    }
+
+    if (needsSpareDestination) {
+        std::unique_ptr<FileData> spareDestination;
+
+        try {
+            spareDestination = std::make_unique<FileData>(parseFile(m_saveData.files.front()));
+        }
+        catch (...) {
+        }
+
+        std::lock_guard<std::mutex> lock{m_session->m_mutex};
+        m_session->m_spareDestination = std::move(spareDestination);
+        m_session->m_isParsingSpareDestination = false;
+    }
+}
+
+std::shared_ptr<PdfSaver::FileData> PdfSaver::Session::input(const Glib::RefPtr<Gio::File>& file)
+{
+    std::promise<std::shared_ptr<FileData>> promise;
+    ParsedFile parsedFile;
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        // Whoever asks first parses the file; everyone else waits for it
+        if (auto it = m_inputs.find(file->get_path()); it != m_inputs.end())
+            return it->second.get();
+
+        parsedFile = promise.get_future().share();
+        m_inputs.emplace(file->get_path(), parsedFile);
+    }
+
+    try {
+        promise.set_value(std::make_shared<FileData>(parseFile(file)));
+    }
+    catch (...) {
+        promise.set_exception(std::current_exception());
+
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_inputs.erase(file->get_path());
+    }
+
+    return parsedFile.get();
+}
+
+// Doesn't wait for the inputs that are still being parsed
+std::shared_ptr<PdfSaver::FileData> PdfSaver::Session::parsedInput(const Glib::RefPtr<Gio::File>& file)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_inputs.find(file->get_path());
+
+    if (it == m_inputs.end() || it->second.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+        return nullptr;
+
+    try {
+        return it->second.get();
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+// Inputs already handed out stay alive for as long as their saves need them
+void PdfSaver::Session::keepOnlyInputs(const std::set<std::string>& paths)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    for (auto it = m_inputs.begin(); it != m_inputs.end();) {
+        if (paths.count(it->first) == 0)
+            it = m_inputs.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::shared_ptr<PdfSaver::FileData> PdfSaver::Session::takeDestination(const Glib::RefPtr<Gio::File>& file)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        if (m_spareDestination != nullptr)
+            return std::shared_ptr<FileData>{std::move(m_spareDestination)};
+    }
+
+    return std::make_shared<FileData>(parseFile(file));
+}
+
+PdfSaver::FileData PdfSaver::parseFile(const Glib::RefPtr<Gio::File>& file)
+{
+    auto qpdf = std::make_unique<QPDF>();
+    qpdf->processFile(file->get_path().c_str());
+    auto qpdfPageDocumentHelper = std::make_unique<QPDFPageDocumentHelper>(*qpdf);
+
+    // Pages are looked up on demand, so a big file costs nothing
+    // beyond the pages that are actually kept
+    return FileData{std::move(qpdf),
+                    std::move(qpdfPageDocumentHelper),
+                    {}};
+}
+
+void PdfSaver::loadAllPages(FileData& fileData)
+{
+    if (!fileData.qpdfPages.empty())
+        return;
+
+    fileData.qpdfPages = fileData.qpdfPageDocumentHelper->getAllPages();
+}
+
+// The page as it is in its file. Its inherited attributes
+// only go to its copy in the output, see addPage().
+QPDFPageObjectHelper PdfSaver::pageOf(FileData& fileData, unsigned int pageNumber)
+{
+    if (fileData.qpdfPages.empty()) {
+        QPDFObjectHandle page = findPage(*fileData.qpdf, pageNumber);
+
+        if (page.isDictionary())
+            return QPDFPageObjectHelper{page};
+
+        // The page tree is damaged, so let QPDF repair it
+        loadAllPages(fileData);
+    }
+
+    return fileData.qpdfPages.at(pageNumber);
+}
+
+PdfSaver::SaveReport PdfSaver::save(const Glib::RefPtr<Gio::File>& destinationFile)
+{
+    return save(destinationFile, SaveOptions{});
+}
+
+PdfSaver::SaveReport PdfSaver::save(const Glib::RefPtr<Gio::File>& destinationFile,
+                                    const SaveOptions& options)
+{
+    const std::lock_guard<std::recursive_mutex> sessionLock{m_session->m_userMutex};
+
+    if (options.cacheDirectory)
+        return saveThroughCache(destinationFile, options);
+
+    SaveReport report;
+
+    writeAtomically(destinationFile, options, [this, &report, &options](const Glib::RefPtr<Gio::File>& tempFile) {
+        report = IoExecutor::instance().run([this, &tempFile, &options]() {
+            if (canSaveIncrementally(options) && writeIncrementally(tempFile, options))
+                return SaveReport{};
+
+            const CompressionLevelLock compressionLevelLock{options.profile};
+
+            const SaveReport buildReport = buildOutput(options, tempFile);
+            writeToFile(outputPDF(), tempFile, options, encryptionSource());
+
+            return buildReport;
+        });
+    });
+
+    return report;
+}
+
+PdfSaver::SaveReport PdfSaver::saveThroughCache(const Glib::RefPtr<Gio::File>& destinationFile,
+                                                const SaveOptions& options)
+{
+    SaveOptions uncachedOptions = options;
+    uncachedOptions.cacheDirectory.reset();
+    uncachedOptions.deterministic = true;
+
+    const Glib::RefPtr<Gio::File> cachedFile = IoExecutor::instance().run([this, &options]() {
+        return options.cacheDirectory->get_child(cacheKey(options) + ".pdf");
+    });
+
+    try {
+        writeAtomically(destinationFile, options, [&cachedFile, &options](const Glib::RefPtr<Gio::File>& tempFile) {
+            IoExecutor::instance().run([&cachedFile, &options, &tempFile]() {
+                copyFile(cachedFile, tempFile, options);
+
+                if (options.sync != SyncPolicy::None) {
+                    std::unique_ptr<FILE, decltype(&fclose)> file{QUtil::safe_fopen(tempFile->get_path().c_str(), "rb"),
+                                                                  &fclose};
+                    syncFile(file.get());
+                }
+            });
+        });
+
+        SaveReport report;
+        report.isCached = true;
+
+        return report;
+    }
+    catch (const Gio::Error& error) {
+        if (error.code() != Gio::Error::NOT_FOUND)
+            throw;
+    }
+
+    const SaveReport report = save(destinationFile, uncachedOptions);
+
+    // The save succeeded even if its output can't be kept
+    try {
+        IoExecutor::instance().run([&options]() {
+            if (!options.cacheDirectory->query_exists())
+                options.cacheDirectory->make_directory_with_parents();
+        });
+
+        writeAtomically(cachedFile, SaveOptions{}, [&destinationFile](const Glib::RefPtr<Gio::File>& tempFile) {
+            IoExecutor::instance().run([&destinationFile, &tempFile]() {
+                destinationFile->copy(tempFile, Gio::FILE_COPY_OVERWRITE);
+            });
+        });
+    }
+    catch (...) {
+    }
+
+    return report;
+}
+
+PdfSaver::SaveReport PdfSaver::saveToBuffer(std::vector<unsigned char>& buffer,
+                                            const SaveOptions& options)
+{
+    const std::lock_guard<std::recursive_mutex> sessionLock{m_session->m_userMutex};
+
+    return IoExecutor::instance().run([this, &buffer, &options]() {
+        const CompressionLevelLock compressionLevelLock{options.profile};
+        const SaveReport report = buildOutput(options);
+        VectorPipeline output{buffer};
+        writeOutput(outputPDF(), output, options, encryptionSource());
+
+        return report;
+    });
+}
+
+PdfSaver::SaveReport PdfSaver::saveToDescriptor(int fileDescriptor,
+                                                const SaveOptions& options)
+{
+    const std::lock_guard<std::recursive_mutex> sessionLock{m_session->m_userMutex};
+
+    return IoExecutor::instance().run([this, fileDescriptor, &options]() {
+        const CompressionLevelLock compressionLevelLock{options.profile};
+        const SaveReport report = buildOutput(options);
+        DescriptorPipeline output{fileDescriptor};
+        writeOutput(outputPDF(), output, options, encryptionSource());
+
+        if (options.sync != SyncPolicy::None)
+            syncDescriptor(fileDescriptor);
+
+        return report;
+    });
+}
+
+PdfSaver::SaveReport PdfSaver::saveSplit(const std::vector<SplitOutput>& outputs,
+                                         const SaveOptions& options)
+{
+    for (const SplitOutput& output : outputs)
+        if (output.firstPage > output.lastPage || output.lastPage >= m_saveData.pages.size())
+            throw std::runtime_error("The page range of an output is out of the document");
+
+    // Each output would report its own progress at the same time
+    SaveOptions outputOptions = options;
+    outputOptions.onProgress = nullptr;
+
+    const std::lock_guard<std::recursive_mutex> sessionLock{m_session->m_userMutex};
+
+    return IoExecutor::instance().run([this, &outputs, &options, &outputOptions]() {
+        const CompressionLevelLock compressionLevelLock{options.profile};
+        parseInputs();
+
+        SaveReport report;
+        std::atomic<std::size_t> bytesWritten{0};
+
+        // Outputs are built one at a time, because they all borrow objects
+        // from the shared inputs. Once built they no longer touch the inputs,
+        // so a batch of them can be written in parallel.
+        const auto batchSize = static_cast<std::size_t>(IoExecutor::instance().maxConcurrency());
+
+        for (std::size_t first = 0; first < outputs.size(); first += batchSize) {
+            const std::size_t last = std::min(first + batchSize, outputs.size());
+            std::vector<std::unique_ptr<QPDF>> batch;
+
+            for (std::size_t i = first; i < last; ++i) {
+                throwIfCanceled(options);
+                const SplitOutput& output = outputs.at(i);
+                batch.push_back(buildOutputFromScratch(output.firstPage, output.lastPage, outputOptions, report));
+                materializeStreams(*batch.back());
+            }
+
+            IoExecutor::instance().parallelFor(batch.size(), [&](std::size_t i) {
+                writeAtomically(outputs.at(first + i).destinationFile,
+                                outputOptions,
+                                [&](const Glib::RefPtr<Gio::File>& tempFile) {
+                                    bytesWritten += writeToFile(*batch.at(i),
+                                                                tempFile,
+                                                                outputOptions,
+                                                                m_filesData.front()->qpdf.get());
+                                });
+            });
+
+            if (options.onProgress)
+                options.onProgress(SaveProgress{static_cast<int>(last * 100 / outputs.size()),
+                                                bytesWritten});
+        }
+
+        return report;
+    });
+}
+
+PdfSaver::SaveEstimate PdfSaver::estimate(const SaveOptions& options)
+{
+    // Looking into an input caches its pages, so it has to wait for the
+    // saver using the session. The estimate goes without instead.
+    const std::unique_lock<std::recursive_mutex> sessionLock{m_session->m_userMutex, std::try_to_lock};
+
+    return IoExecutor::instance().run([this, &options, &sessionLock]() {
+        SaveEstimate result;
+
+        if (canSaveIncrementally(options)) {
+            result.bytes = static_cast<std::size_t>(
+                m_saveData.files.front()->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE)->get_size());
+            result.duration = writeDuration(result.bytes, copyThroughput);
+
+            return result;
+        }
+
+        std::map<unsigned int, std::vector<unsigned int>> pagesByFile;
+
+        for (const PageData& page : m_saveData.pages)
+            pagesByFile[page.file].push_back(page.pageNumber);
+
+        for (const auto& [file, pageNumbers] : pagesByFile) {
+            const Glib::RefPtr<Gio::File>& inputFile = m_saveData.files.at(file);
+
+            // The first file is never among the inputs of the session,
+            // as every save consumes its own copy of it
+            std::shared_ptr<FileData> fileData = file != 0 && sessionLock.owns_lock()
+                                                     ? m_session->parsedInput(inputFile)
+                                                     : nullptr;
+
+            if (fileData != nullptr)
+                result.bytes += estimateSize(*fileData, pageNumbers, options.profile);
+            else
+                result.bytes += static_cast<std::size_t>(inputFile->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE)->get_size());
+        }
+
+        switch (options.profile) {
+        case SaveProfile::Fast:
+            result.duration = writeDuration(result.bytes, fastThroughput);
+            break;
+        case SaveProfile::Balanced:
+            result.duration = writeDuration(result.bytes, balancedThroughput);
+            break;
+        case SaveProfile::Compact:
+            result.duration = writeDuration(result.bytes, compactThroughput);
+            break;
+        }
+
+        // Linearization writes the file twice
+        if (options.linearize)
+            result.duration *= 2;
+
+        return result;
+    });
+}
+
+std::size_t PdfSaver::estimateSize(FileData& fileData,
+                                   const std::vector<unsigned int>& pageNumbers,
+                                   SaveProfile profile)
+{
+    std::size_t result = 0;
+    std::set<QPDFObjGen> visited;
+
+    for (const unsigned int pageNumber : pageNumbers) {
+        QPDFObjectHandle page = pageOf(fileData, pageNumber).getObjectHandle();
+
+        // The rest of the page tree doesn't end up in the output
+        for (QPDFObjectHandle node = page.getKey("/Parent");
+             node.isDictionary() && visited.insert(node.getObjGen()).second;
+             node = node.getKey("/Parent")) {
+        }
+
+        result += estimatedPageOverhead;
+
+        for (QPDFObjectHandle& stream : reachableStreams(page, visited)) {
+            QPDFObjectHandle dictionary = stream.getDict();
+            QPDFObjectHandle length = dictionary.getKey("/Length");
+
+            if (!length.isInteger() || length.getIntValue() < 0)
+                continue;
+
+            auto size = static_cast<std::size_t>(length.getIntValue());
+
+            // Every profile but the fast one compresses unfiltered streams
+            if (profile != SaveProfile::Fast && dictionary.getKey("/Filter").isNull())
+                size /= estimatedCompressionRatio;
+
+            result += size;
+        }
+    }
+
+    return result;
+}
+
+void PdfSaver::writeAtomically(const Glib::RefPtr<Gio::File>& destinationFile,
+                               const SaveOptions& options,
+                               const std::function<void(const Glib::RefPtr<Gio::File>&)>& writeTo)
+{
+    // Remote destinations have no local path to write next to
+    const bool canWriteNextToDestination = options.writeNextToDestination
+                                           && !destinationFile->get_path().empty();
+    Glib::RefPtr<Gio::File> tempFile = canWriteNextToDestination
+                                           ? TempFile::generateNextTo(destinationFile)
+                                           : TempFile::generate();
+
+    try {
+        writeTo(tempFile);
+        TempFile::moveTo(tempFile, destinationFile);
+    }
+    catch (...) {
+        // Don't leave a partial output behind
+        if (tempFile->query_exists())
+            tempFile->remove();
+
+        throw;
+    }
+
+    if (options.sync == SyncPolicy::None || destinationFile->get_path().empty())
+        return;
+
+    // Moves across filesystems copy the data, which is then not on disk yet
+    if (!canWriteNextToDestination)
+        TempFile::syncFile(destinationFile);
+
+    if (options.sync == SyncPolicy::FileAndDirectory)
+        TempFile::syncDirectory(destinationFile->get_parent());
+}
+
+QPDF& PdfSaver::outputPDF() const
+{
+    return m_scratchPDF != nullptr ? *m_scratchPDF : *m_filesData.front()->qpdf;
+}
+
+QPDF* PdfSaver::encryptionSource() const
+{
+    return m_encryptionSource != nullptr ? m_encryptionSource->qpdf.get() : nullptr;
+}
+
+bool PdfSaver::isStreamed(const SaveOptions& options) const
+{
+    return options.streamInputs || m_saveData.files.size() > streamingChunkSize;
+}
+
+PdfSaver::SaveReport& PdfSaver::SaveReport::operator+=(const SaveReport& other)
+{
+    deduplicatedStreams += other.deduplicatedStreams;
+    bytesSaved += other.bytesSaved;
+    downsampledImages += other.downsampledImages;
+    imageBytesSaved += other.imageBytesSaved;
+
+    return *this;
+}
+
+bool PdfSaver::canSaveIncrementally(const SaveOptions& options) const
+{
+    if (!options.incremental || options.linearize || options.imageResolution > 0 || m_saveData.files.empty()
+        || m_saveData.files.front()->get_path().empty())
+        return false;
+
+    std::set<unsigned int> pageNumbers;
+
+    for (const PageData& page : m_saveData.pages)
+        if (page.file != 0 || !pageNumbers.insert(page.pageNumber).second)
+            return false;
+
+    return true;
+}
+
+// Copies the first file and appends an update made of the changed page
+// dictionaries, a flat page tree and a cross-reference table pointing
+// back to the original one. Returns false, leaving the copy to be
+// overwritten by a full save, when the file can't be updated this way.
+bool PdfSaver::writeIncrementally(const Glib::RefPtr<Gio::File>& destinationFile,
+                                  const SaveOptions& options)
+{
+    copyFile(m_saveData.files.front(), destinationFile, options);
+
+    const std::string path = destinationFile->get_path();
+    std::unique_ptr<FILE, decltype(&fclose)> outputFile{QUtil::safe_fopen(path.c_str(), "r+b"), &fclose};
+    const qpdf_offset_t previousXref = lastXrefTableOffset(outputFile.get());
+
+    if (previousXref < 0)
+        return false;
+
+    // The copy is parsed instead of the original, so the object
+    // numbers surely match the offsets being appended to
+    QPDF pdf;
+    pdf.processFile(path.c_str());
+    QPDFObjectHandle pages = pdf.getRoot().getKey("/Pages");
+
+    if (pdf.isEncrypted() || pdf.getTrailer().hasKey("/XRefStm") || !pages.isIndirect())
+        return false;
+
+    // Every page is kept at most once, so fewer pages means some were removed
+    if (QPDFPageDocumentHelper{pdf}.getAllPages().size() != m_saveData.pages.size())
+        return false;
+
+    std::vector<QPDFObjectHandle> changedObjects;
+    QPDFObjectHandle kids = QPDFObjectHandle::newArray();
+
+    for (const PageData& page : m_saveData.pages) {
+        QPDFObjectHandle pageObject = findPage(pdf, page.pageNumber);
+
+        // The page tree is damaged
+        if (!pageObject.isIndirect())
+            return false;
+
+        if (updatePage(pageObject, pages, page.rotation))
+            changedObjects.push_back(pageObject);
+
+        kids.appendItem(pageObject);
+    }
+
+    // Attributes inherited from the root stay where they are
+    pages.replaceKey("/Kids", kids);
+    pages.replaceKey("/Count", QPDFObjectHandle::newInteger(kids.getArrayNItems()));
+    changedObjects.push_back(pages);
+
+    QUtil::seek(outputFile.get(), 0, SEEK_END);
+    const qpdf_offset_t updateOffset = QUtil::tell(outputFile.get());
+    std::string update = "\n";
+    std::string xref = "xref\n";
+
+    for (QPDFObjectHandle& object : changedObjects) {
+        const std::string objectNumber = QUtil::int_to_string(object.getObjectID());
+        const int generation = object.getGeneration();
+
+        xref += objectNumber + " 1\n"
+                + QUtil::int_to_string(updateOffset + static_cast<qpdf_offset_t>(update.size()), 10) + " "
+                + QUtil::int_to_string(generation, 5) + " n \n";
+        update += objectNumber + " " + QUtil::int_to_string(generation) + " obj\n"
+                  + object.unparseResolved() + "\nendobj\n";
+    }
+
+    QPDFObjectHandle trailer = pdf.getTrailer().shallowCopy();
+    trailer.replaceKey("/Prev", QPDFObjectHandle::newInteger(previousXref));
+
+    const qpdf_offset_t xrefOffset = updateOffset + static_cast<qpdf_offset_t>(update.size());
+    update += xref + "trailer\n" + trailer.unparseResolved() + "\nstartxref\n"
+              + QUtil::int_to_string(xrefOffset) + "\n%%EOF\n";
+
+    if (fwrite(update.data(), 1, update.size(), outputFile.get()) != update.size())
+        throw std::runtime_error("The output file could not be written");
+
+    if (options.sync != SyncPolicy::None)
+        syncFile(outputFile.get());
+
+    if (fclose(outputFile.release()) != 0)
+        throw std::runtime_error("The output file could not be written");
+
+    if (options.onProgress)
+        options.onProgress(SaveProgress{100, update.size()});
+
+    return true;
+}
+
+// Everything the output depends on. Inputs are told apart by the versions
+// the document gives, or else by their location, size and modification
+// tag, as hashing their contents would cost about as much as saving them.
+std::string PdfSaver::cacheKey(const SaveOptions& options) const
 {
-    for (const auto& file : m_saveData.files) {
-        auto qpdf = std::make_unique<QPDF>();
-        qpdf->processFile(file->get_path().c_str());
-        auto qpdfPageDocumentHelper = std::make_unique<QPDFPageDocumentHelper>(*qpdf);
-        std::vector<QPDFPageObjectHelper> pages = qpdfPageDocumentHelper->getAllPages();
+    Glib::Checksum checksum{Glib::Checksum::CHECKSUM_SHA256};
 
-        qpdfPageDocumentHelper->pushInheritedAttributesToPage();
+    auto add = [&checksum](const std::string& value) {
+        checksum.update(value + "\n");
+    };
 
-        m_filesData.emplace_back(FileData{std::move(qpdf),
-                                          std::move(qpdfPageDocumentHelper),
-                                          std::move(pages)});
+    add(std::to_string(cacheFormatVersion));
+
+    if (m_saveData.fileVersions.size() == m_saveData.files.size()) {
+        for (const std::string& fileVersion : m_saveData.fileVersions)
+            add(fileVersion);
+    }
+    else {
+        for (const Glib::RefPtr<Gio::File>& file : m_saveData.files) {
+            const Glib::RefPtr<Gio::FileInfo> info = file->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE
+                                                                      "," G_FILE_ATTRIBUTE_ETAG_VALUE);
+            add(file->get_uri());
+            add(std::to_string(info->get_size()));
+            add(info->get_etag());
+        }
     }
+
+    for (const PageData& page : m_saveData.pages)
+        add(std::to_string(page.file) + " " + std::to_string(page.pageNumber) + " " + std::to_string(page.rotation));
+
+    add(std::to_string(static_cast<int>(options.profile)));
+    add(std::to_string(options.linearize));
+    add(std::to_string(options.incremental));
+    add(std::to_string(options.streamInputs));
+    add(std::to_string(options.imageResolution));
+
+    return checksum.get_string();
 }
 
-void PdfSaver::save(const Glib::RefPtr<Gio::File>& destinationFile)
+bool PdfSaver::isSubsetOfFirstFile() const
 {
-    Glib::RefPtr<Gio::File> tempFile = TempFile::generate();
-    persist(tempFile);
-    tempFile->move(destinationFile, Gio::FILE_COPY_OVERWRITE);
+    QPDFObjectHandle count = m_filesData.front()->qpdf->getRoot().getKey("/Pages").getKey("/Count");
+
+    return !m_saveData.pages.empty()
+           && std::all_of(m_saveData.pages.begin(), m_saveData.pages.end(), [](const PageData& page) {
+                  return page.file == 0;
+              })
+           && count.isInteger()
+           && static_cast<long long>(m_saveData.pages.size() * subsetRatio) <= count.getIntValue();
 }
 
-void PdfSaver::persist(const Glib::RefPtr<Gio::File>& destinationFile)
+PdfSaver::SaveReport PdfSaver::buildOutput(const SaveOptions& options,
+                                           const Glib::RefPtr<Gio::File>& spoolLocation)
 {
+    throwIfCanceled(options);
+
+    m_scratchPDF.reset();
+    m_encryptionSource.reset();
+
+    if (isStreamed(options)) {
+        SaveReport report;
+        m_scratchPDF = buildStreamedOutput(options, spoolLocation, report);
+
+        return report;
+    }
+
+    parseInputs();
+
+    if (isSubsetOfFirstFile()) {
+        SaveReport report;
+        m_scratchPDF = buildOutputFromScratch(0,
+                                             static_cast<unsigned int>(m_saveData.pages.size() - 1),
+                                             options,
+                                             report);
+        m_encryptionSource = m_filesData.front();
+
+        return report;
+    }
+
     // Use the hollow shell of the first PDF to build the result.
     // This preserves the metadata and outline of that file.
-    QPDF* destinationPDF = m_filesData.front().qpdf.get();
-    QPDFPageDocumentHelper* destinationPageDocumentHelper = m_filesData.front().qpdfPageDocumentHelper.get();
-    const std::vector<QPDFPageObjectHelper> originalPages = destinationPageDocumentHelper->getAllPages();
+    loadAllPages(*m_filesData.front());
+    QPDF* destinationPDF = m_filesData.front()->qpdf.get();
+    QPDFPageDocumentHelper* destinationPageDocumentHelper = m_filesData.front()->qpdfPageDocumentHelper.get();
+    const std::vector<QPDFPageObjectHelper> originalPages = m_filesData.front()->qpdfPages;
 
     for (const auto& qpdfPage : originalPages)
         destinationPageDocumentHelper->removePage(qpdfPage);
@@ -47,9 +1724,8 @@ void PdfSaver::persist(const Glib::RefPtr<Gio::File>& destinationFile)
     std::set<int> preserverdPagesFromOriginalFile;
 
     for (PageData page : m_saveData.pages) {
-        QPDFPageObjectHelper qpdfPage = m_filesData.at(page.file).qpdfPages.at(page.pageNumber);
-        qpdfPage.rotatePage(page.rotation, false);
-        destinationPageDocumentHelper->addPage(qpdfPage, false);
+        QPDFPageObjectHelper qpdfPage = pageOf(*m_filesData.at(page.file), page.pageNumber);
+        addPage(*destinationPDF, *destinationPageDocumentHelper, qpdfPage, page.rotation);
 
         if (page.file == 0)
             preserverdPagesFromOriginalFile.insert(static_cast<int>(page.pageNumber));
@@ -66,12 +1742,439 @@ void PdfSaver::persist(const Glib::RefPtr<Gio::File>& destinationFile)
             originalPages.at(static_cast<unsigned>(pageNumber)).getObjectHandle().getObjGen(),
             QPDFObjectHandle::newNull());
 
-    destinationPageDocumentHelper->removeUnreferencedResources();
+    return optimizeOutput(*destinationPDF, *destinationPageDocumentHelper, options);
+}
+
+// Only the objects reachable from the kept pages are resolved, so the
+// cost follows the size of the output instead of the size of the inputs
+std::unique_ptr<QPDF> PdfSaver::buildOutputFromScratch(unsigned int firstPage,
+                                                       unsigned int lastPage,
+                                                       const SaveOptions& options,
+                                                       SaveReport& report)
+{
+    auto destinationPDF = std::make_unique<QPDF>();
+    destinationPDF->emptyPDF();
+    QPDFPageDocumentHelper destinationPageDocumentHelper{*destinationPDF};
+
+    QPDFObjectHandle info = m_filesData.front()->qpdf->getTrailer().getKey("/Info");
+
+    if (info.isIndirect())
+        destinationPDF->getTrailer().replaceKey("/Info", destinationPDF->copyForeignObject(info));
+
+    std::vector<QPDFObjectHandle> pagesOfFirstFile;
+
+    for (unsigned int i = firstPage; i <= lastPage; ++i) {
+        const PageData& page = m_saveData.pages.at(i);
+        QPDFPageObjectHelper qpdfPage = pageOf(*m_filesData.at(page.file), page.pageNumber);
+        addPage(*destinationPDF, destinationPageDocumentHelper, qpdfPage, page.rotation);
+
+        if (page.file == 0)
+            pagesOfFirstFile.push_back(qpdfPage.getObjectHandle());
+    }
+
+    // The outline, forms and the like of the first file are of no use
+    // to the parts of a split that have none of its pages
+    if (!pagesOfFirstFile.empty())
+        copyCatalogEntries(*destinationPDF, *m_filesData.front()->qpdf, pagesOfFirstFile);
+
+    report += optimizeOutput(*destinationPDF, destinationPageDocumentHelper, options);
+
+    return destinationPDF;
+}
+
+// Only a bounded number of inputs is open at any time. The streams of every
+// copied page are spooled right away, so any input but the first can be
+// closed to make room for the next one.
+std::unique_ptr<QPDF> PdfSaver::buildStreamedOutput(const SaveOptions& options,
+                                                    const Glib::RefPtr<Gio::File>& spoolLocation,
+                                                    SaveReport& report)
+{
+    auto destinationPDF = std::make_unique<QPDF>();
+    destinationPDF->emptyPDF();
+    QPDFPageDocumentHelper destinationPageDocumentHelper{*destinationPDF};
+
+    auto* spool = new SpoolProvider{spoolLocation};
+    PointerHolder<QPDFObjectHandle::StreamDataProvider> spoolProvider{spool};
+    std::set<QPDFObjGen> spooledObjects{destinationPDF->getRoot().getKey("/Pages").getObjGen()};
+
+    auto spoolStreamsOf = [spool, &spoolProvider, &spooledObjects](QPDFObjectHandle root) {
+        for (QPDFObjectHandle& stream : reachableStreams(root, spooledObjects)) {
+            QPDFObjectHandle dictionary = stream.getDict();
+            spool->spool(stream);
+            stream.replaceStreamData(spoolProvider,
+                                     dictionary.getKey("/Filter"),
+                                     dictionary.getKey("/DecodeParms"));
+        }
+    };
+
+    // The first input stays open until its catalog is copied, after the
+    // pages. Least recently used inputs among the others go first.
+    std::unique_ptr<FileData> firstInput;
+    std::list<std::pair<unsigned int, std::unique_ptr<FileData>>> openInputs;
+
+    auto inputOf = [this, &firstInput, &openInputs](unsigned int file) -> FileData& {
+        if (file == 0)
+            return *firstInput;
+
+        auto it = std::find_if(openInputs.begin(), openInputs.end(), [file](const auto& input) {
+            return input.first == file;
+        });
+
+        if (it != openInputs.end()) {
+            openInputs.splice(openInputs.end(), openInputs, it);
+        }
+        else {
+            if (openInputs.size() == streamingChunkSize - 1)
+                openInputs.pop_front();
+
+            openInputs.emplace_back(file, std::make_unique<FileData>(parseFile(m_saveData.files.at(file))));
+        }
+
+        return *openInputs.back().second;
+    };
+
+    if (!m_saveData.files.empty()) {
+        firstInput = std::make_unique<FileData>(parseFile(m_saveData.files.front()));
+        QPDFObjectHandle info = firstInput->qpdf->getTrailer().getKey("/Info");
+
+        if (info.isIndirect()) {
+            QPDFObjectHandle infoCopy = destinationPDF->copyForeignObject(info);
+            destinationPDF->getTrailer().replaceKey("/Info", infoCopy);
+            spoolStreamsOf(infoCopy);
+        }
+    }
+
+    std::vector<QPDFObjectHandle> pagesOfFirstFile;
+
+    for (const PageData& page : m_saveData.pages) {
+        throwIfCanceled(options);
+
+        QPDFPageObjectHelper qpdfPage = pageOf(inputOf(page.file), page.pageNumber);
+        spoolStreamsOf(addPage(*destinationPDF, destinationPageDocumentHelper, qpdfPage, page.rotation));
+
+        if (page.file == 0)
+            pagesOfFirstFile.push_back(qpdfPage.getObjectHandle());
+    }
+
+    if (!pagesOfFirstFile.empty())
+        for (QPDFObjectHandle& copy : copyCatalogEntries(*destinationPDF, *firstInput->qpdf, pagesOfFirstFile))
+            spoolStreamsOf(copy);
+
+    openInputs.clear();
+
+    // The writer copies the encryption of the first input
+    if (firstInput != nullptr && firstInput->qpdf->isEncrypted())
+        m_encryptionSource = std::move(firstInput);
+
+    firstInput.reset();
+
+    report += optimizeOutput(*destinationPDF, destinationPageDocumentHelper, options);
+
+    return destinationPDF;
+}
+
+PdfSaver::SaveReport PdfSaver::optimizeOutput(QPDF& pdf,
+                                              QPDFPageDocumentHelper& pageDocumentHelper,
+                                              const SaveOptions& options)
+{
+    const SaveProfile profile = options.profile;
+    SaveReport report;
+
+    throwIfCanceled(options);
+
+    // Going through every resource dictionary is slow on big documents
+    if (profile != SaveProfile::Fast)
+        pageDocumentHelper.removeUnreferencedResources();
+
+    // Hashing every stream is only worth it when the smallest output is asked for
+    if (profile == SaveProfile::Compact)
+        report = deduplicateStreams(pdf);
+
+    if (profile == SaveProfile::Compact)
+        recompressStreams(pdf);
+
+    throwIfCanceled(options);
+
+    // Runs after the recompression, which would only compress
+    // the resampled images again
+    if (options.imageResolution > 0)
+        report += downsampleImages(pageDocumentHelper, options);
+
+    throwIfCanceled(options);
+
+    return report;
+}
+
+std::size_t PdfSaver::writeToFile(QPDF& pdf,
+                                  const Glib::RefPtr<Gio::File>& destinationFile,
+                                  const SaveOptions& options,
+                                  QPDF* encryptionSource)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> outputFile{QUtil::safe_fopen(destinationFile->get_path().c_str(), "wb"),
+                                                        &fclose};
+    Pl_StdioFile output{"output file", outputFile.get()};
+    const std::size_t bytesWritten = writeOutput(pdf, output, options, encryptionSource);
+
+    if (options.sync != SyncPolicy::None)
+        syncFile(outputFile.get());
+
+    if (fclose(outputFile.release()) != 0)
+        throw std::runtime_error("The output file could not be written");
+
+    return bytesWritten;
+}
+
+std::size_t PdfSaver::writeOutput(QPDF& pdf,
+                                  Pipeline& output,
+                                  const SaveOptions& options,
+                                  QPDF* encryptionSource)
+{
+    ProgressPipeline progressPipeline{&output, options};
+
+    QPDFWriter writer{pdf};
+    writer.setOutputPipeline(&progressPipeline);
+
+    if (options.onProgress)
+        writer.registerProgressReporter(PointerHolder<QPDFWriter::ProgressReporter>{
+            new SaveProgressReporter{progressPipeline, options}});
+
+    switch (options.profile) {
+    case SaveProfile::Fast:
+        writer.setCompressStreams(false);
+        writer.setDecodeLevel(qpdf_dl_none);
+        break;
+    case SaveProfile::Balanced:
+        break;
+    case SaveProfile::Compact:
+        // Streams were already recompressed by recompressStreams(),
+        // decoding them here would only deflate them a second time
+        writer.setObjectStreamMode(qpdf_o_generate);
+        writer.setDecodeLevel(qpdf_dl_none);
+        break;
+    }
+
+    writer.setLinearization(options.linearize);
+
+    const bool copiesEncryption = &pdf != encryptionSource && encryptionSource != nullptr
+                                  && encryptionSource->isEncrypted();
+
+    // Reading the parameters resolves objects of the first file,
+    // which the writers of a split share
+    if (copiesEncryption) {
+        static std::mutex encryptionSourceMutex;
+        const std::lock_guard<std::mutex> lock{encryptionSourceMutex};
+        writer.copyEncryptionParameters(*encryptionSource);
+    }
+
+    // QPDF can't derive the ID of an encrypted file from its contents
+    if (options.deterministic && !pdf.isEncrypted() && !copiesEncryption)
+        writer.setDeterministicID(true);
 
-    // Write the result to a file
-    QPDFWriter writer{*destinationPDF};
-    writer.setOutputFilename(destinationFile->get_path().c_str());
     writer.write();
+
+    return progressPipeline.bytesWritten();
+}
+
+PdfSaver::SaveReport PdfSaver::deduplicateStreams(QPDF& pdf)
+{
+    SaveReport report;
+    std::map<QPDFObjGen, QPDFObjectHandle> replacements;
+    std::map<std::string, std::vector<QPDFObjectHandle>> canonicalStreams;
+
+    // Inputs made by the same generator usually carry identical fonts,
+    // images and color profiles. Streams with the same dictionary and the
+    // same hash of their raw data are compared byte by byte, and the equal
+    // ones are interchangeable.
+    for (QPDFObjectHandle& stream : reachableStreams(pdf)) {
+        HashPipeline hash;
+
+        if (!stream.pipeStreamData(&hash, 0, qpdf_dl_none))
+            continue;
+
+        std::vector<QPDFObjectHandle>& candidates = canonicalStreams[hash.digest() + dictionaryOf(stream)];
+
+        const auto canonicalStream = std::find_if(candidates.begin(), candidates.end(), [&stream](const QPDFObjectHandle& candidate) {
+            return haveSameData(stream, candidate);
+        });
+
+        if (canonicalStream == candidates.end()) {
+            candidates.push_back(stream);
+            continue;
+        }
+
+        replacements.emplace(stream.getObjGen(), *canonicalStream);
+        report.deduplicatedStreams++;
+        report.bytesSaved += hash.size();
+    }
+
+    if (!replacements.empty())
+        replaceReferences(pdf, replacements);
+
+    return report;
+}
+
+// Only the pixels are resampled on the workers, as QPDF isn't
+// thread-safe. Decoded images are handled in batches to bound memory.
+PdfSaver::SaveReport PdfSaver::downsampleImages(QPDFPageDocumentHelper& pageDocumentHelper,
+                                                const SaveOptions& options)
+{
+    struct Image {
+        QPDFObjectHandle stream;
+        int width;
+        int height;
+        int components;
+        int newWidth;
+        int newHeight;
+        bool isJpeg;
+        PointerHolder<Buffer> data;
+    };
+
+    SaveReport report;
+    std::map<QPDFObjGen, std::pair<QPDFObjectHandle, double>> images;
+
+    for (QPDFPageObjectHelper& page : pageDocumentHelper.getAllPages()) {
+        const double side = pageSide(page.getObjectHandle());
+        std::set<QPDFObjGen> visitedForms;
+
+        if (side > 0)
+            collectImages(page.getObjectHandle().getKey("/Resources"), side, images, visitedForms);
+    }
+
+    // Lossy images stay lossy and lossless ones stay lossless,
+    // unless the smallest output is asked for
+    const bool isSmooth = options.profile != SaveProfile::Fast;
+    const bool alwaysJpeg = options.profile == SaveProfile::Compact;
+
+    std::vector<Image> batch;
+    std::size_t batchSize = 0;
+
+    auto resampleBatch = [&]() {
+        CpuExecutor::instance().parallelFor(batch.size(), [&batch, isSmooth](std::size_t i) {
+            Image& image = batch.at(i);
+            PointerHolder<Buffer> pixels = resample(*image.data,
+                                                    image.width,
+                                                    image.height,
+                                                    image.components,
+                                                    image.newWidth,
+                                                    image.newHeight,
+                                                    isSmooth);
+
+            image.data = image.isJpeg ? encodeJpeg(*pixels, image.newWidth, image.newHeight, image.components)
+                                      : deflate(*pixels);
+        });
+
+        for (Image& image : batch) {
+            const std::size_t originalSize = image.stream.getRawStreamData()->getSize();
+
+            if (image.data->getSize() >= originalSize)
+                continue;
+
+            image.stream.replaceStreamData(image.data,
+                                           QPDFObjectHandle::newName(image.isJpeg ? "/DCTDecode" : "/FlateDecode"),
+                                           QPDFObjectHandle::newNull());
+            image.stream.getDict().replaceKey("/Width", QPDFObjectHandle::newInteger(image.newWidth));
+            image.stream.getDict().replaceKey("/Height", QPDFObjectHandle::newInteger(image.newHeight));
+
+            ++report.downsampledImages;
+            report.imageBytesSaved += originalSize - image.data->getSize();
+        }
+
+        batch.clear();
+        batchSize = 0;
+    };
+
+    for (auto& [objGen, use] : images) {
+        throwIfCanceled(options);
+
+        QPDFObjectHandle& stream = use.first;
+        const int components = resampledComponents(stream);
+
+        if (components == 0)
+            continue;
+
+        QPDFObjectHandle dictionary = stream.getDict();
+        const auto width = static_cast<int>(dictionary.getKey("/Width").getIntValue());
+        const auto height = static_cast<int>(dictionary.getKey("/Height").getIntValue());
+        const double ratio = options.imageResolution * use.second / std::max(width, height);
+
+        if (width <= 0 || height <= 0 || ratio >= minimumResampleRatio)
+            continue;
+
+        Pl_Buffer decoded{"decoded image"};
+
+        // Images with filters QPDF can't decode, like JBIG2, are left alone
+        if (!stream.pipeStreamData(&decoded, 0, qpdf_dl_all, true))
+            continue;
+
+        PointerHolder<Buffer> data{decoded.getBuffer()};
+
+        if (data->getSize() != static_cast<std::size_t>(width) * height * components)
+            continue;
+
+        QPDFObjectHandle filter = dictionary.getKey("/Filter");
+        const bool isJpeg = alwaysJpeg || (filter.isName() && filter.getName() == "/DCTDecode");
+
+        batchSize += data->getSize();
+        batch.push_back(Image{stream,
+                              width,
+                              height,
+                              components,
+                              std::max(1, static_cast<int>(std::lround(width * ratio))),
+                              std::max(1, static_cast<int>(std::lround(height * ratio))),
+                              isJpeg,
+                              data});
+
+        if (batchSize >= recompressionBatchSize)
+            resampleBatch();
+    }
+
+    resampleBatch();
+
+    return report;
+}
+
+void PdfSaver::recompressStreams(QPDF& pdf)
+{
+    struct DecodedStream {
+        QPDFObjectHandle stream;
+        PointerHolder<Buffer> data;
+    };
+
+    std::vector<DecodedStream> batch;
+    std::size_t batchSize = 0;
+
+    // QPDF isn't thread-safe, so reading and replacing the stream data
+    // happens here. Only the compression runs on the workers.
+    auto recompressBatch = [&batch, &batchSize]() {
+        CpuExecutor::instance().parallelFor(batch.size(), [&batch](std::size_t i) {
+            batch.at(i).data = deflate(*batch.at(i).data);
+        });
+
+        for (DecodedStream& decodedStream : batch)
+            decodedStream.stream.replaceStreamData(decodedStream.data,
+                                                   QPDFObjectHandle::newName("/FlateDecode"),
+                                                   QPDFObjectHandle::newNull());
+
+        batch.clear();
+        batchSize = 0;
+    };
+
+    for (QPDFObjectHandle& stream : reachableStreams(pdf)) {
+        Pl_Buffer decoded{"decoded stream"};
+
+        // Streams with filters QPDF can't decode, like images, are left alone
+        if (!stream.pipeStreamData(&decoded, 0, qpdf_dl_generalized, true))
+            continue;
+
+        PointerHolder<Buffer> data{decoded.getBuffer()};
+        batchSize += data->getSize();
+        batch.push_back(DecodedStream{stream, data});
+
+        if (batchSize >= recompressionBatchSize)
+            recompressBatch();
+    }
+
+    recompressBatch();
 }
 
 } // namespace Slicer
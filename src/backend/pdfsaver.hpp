@@ -1,29 +1,191 @@
 #ifndef PDFSAVER_HPP
 #define PDFSAVER_HPP
 
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
 #include <vector>
 #include <giomm/file.h>
+#include <qpdf/Pipeline.hh>
 #include <qpdf/QPDF.hh>
 #include <qpdf/QPDFPageDocumentHelper.hh>
 
 namespace Slicer {
 
 class PdfSaver {
+private:
+    struct FileData;
+
 public:
+    // Fast copies streams as they are and skips the resource cleanup.
+    // Balanced removes unreferenced resources and leaves the rest to QPDF.
+    // Compact also merges identical streams of the inputs, packs objects
+    // into object streams and recompresses every stream at the highest
+    // compression level. As QPDF has a single compression level, compact
+    // saves wait for the other saves to finish.
+    enum class SaveProfile {
+        Fast,
+        Balanced,
+        Compact
+    };
+
+    // How much of the output is flushed to disk before save() returns.
+    // Syncing the directory also makes the final rename durable. When the
+    // output is moved from the temporary directory, the destination file
+    // is synced after the move, which may have been a copy. Destinations
+    // without a local path, like remote GIO locations, can't be synced:
+    // the policy only applies to the temporary file there.
+    enum class SyncPolicy {
+        None,
+        File,
+        FileAndDirectory
+    };
+
+    struct SaveProgress {
+        int percentage;
+        std::size_t bytesWritten;
+    };
+
+    struct SaveOptions {
+        SaveProfile profile = SaveProfile::Balanced;
+        // Lets viewers show the first page before the whole file is downloaded
+        bool linearize = false;
+        // Writing next to the destination turns the final move into an
+        // atomic rename, instead of a copy from the temporary directory
+        bool writeNextToDestination = true;
+        SyncPolicy sync = SyncPolicy::None;
+        // Opens only a few inputs at a time, for merges of many files.
+        // It's always done when there are too many inputs to keep open.
+        bool streamInputs = false;
+        // Appends the new page tree to a copy of the first file, when its
+        // pages were only reordered or rotated. The cleanup of the profile
+        // is skipped then. Other saves, and linearized ones, ignore it, as
+        // do saves that remove pages: those would stay in the original
+        // bytes for anyone to recover.
+        bool incremental = false;
+        // Images with more pixels than this many per inch of the page they
+        // are on get resampled. Compact also turns them into JPEG images.
+        // Zero leaves images alone.
+        int imageResolution = 0;
+        // Derives the file ID from the contents instead of from the time,
+        // so saving the same thing twice writes the same bytes. Encrypted
+        // outputs still get a random ID.
+        bool deterministic = false;
+        // Outputs of save() are kept here, named after everything they
+        // depend on. Saving the same pages of unchanged inputs with the
+        // same options again copies the kept output. Implies deterministic.
+        Glib::RefPtr<Gio::File> cacheDirectory;
+        // Called from the saving thread
+        std::function<void(const SaveProgress&)> onProgress;
+        // Polled while saving. Once it returns true, save() throws
+        // TaskCanceled and the partial output is deleted.
+        std::function<bool()> isCanceled;
+    };
+
     struct PageData {
         unsigned int file;
         unsigned int pageNumber;
         int rotation;
     };
 
+    // Keeps the inputs of a document parsed across saves. Only the files
+    // that still have pages in the document are kept.
+    // The first file is special: its QPDF instance becomes the output,
+    // so it's consumed by every save. A spare copy of it is parsed ahead
+    // of time by PdfSaver::warmUp().
+    // QPDF isn't thread-safe, and even reading an input caches objects in
+    // it, so only one saver at a time may use a session. The saves hold
+    // it for their whole run, while warmUp() and estimate() don't wait
+    // for it: they do without the session when it's in use.
+    class Session {
+    private:
+        using ParsedFile = std::shared_future<std::shared_ptr<FileData>>;
+
+        // Held by the saver using the session. Saving through the cache
+        // saves again, hence the recursion.
+        std::recursive_mutex m_userMutex;
+        // Guards the members below
+        std::mutex m_mutex;
+        std::map<std::string, ParsedFile> m_inputs;
+        std::unique_ptr<FileData> m_spareDestination;
+        bool m_isParsingSpareDestination = false;
+
+        std::shared_ptr<FileData> input(const Glib::RefPtr<Gio::File>& file);
+        std::shared_ptr<FileData> parsedInput(const Glib::RefPtr<Gio::File>& file);
+        std::shared_ptr<FileData> takeDestination(const Glib::RefPtr<Gio::File>& file);
+        void keepOnlyInputs(const std::set<std::string>& paths);
+
+        friend class PdfSaver;
+    };
+
+    struct SaveReport {
+        unsigned int deduplicatedStreams = 0;
+        std::size_t bytesSaved = 0;
+        unsigned int downsampledImages = 0;
+        std::size_t imageBytesSaved = 0;
+        // The output was copied from the cache
+        bool isCached = false;
+
+        SaveReport& operator+=(const SaveReport& other);
+    };
+
+    // Only a rough guess, meant for choosing between profiles
+    struct SaveEstimate {
+        std::size_t bytes = 0;
+        std::chrono::milliseconds duration{0};
+    };
+
+    // The pages from firstPage to lastPage (both included) of SaveData::pages
+    struct SplitOutput {
+        unsigned int firstPage;
+        unsigned int lastPage;
+        Glib::RefPtr<Gio::File> destinationFile;
+    };
+
     struct SaveData {
         std::vector<Glib::RefPtr<Gio::File>> files;
+        // One per file, which changes whenever the contents of the file
+        // may have. The output cache goes by these when they're given,
+        // as the files themselves are copies made anew by every session.
+        std::vector<std::string> fileVersions;
         std::vector<PageData> pages;
+        std::shared_ptr<Session> session;
     };
 
     PdfSaver(const SaveData& saveData);
 
-    void save(const Glib::RefPtr<Gio::File>& destinationFile);
+    SaveReport save(const Glib::RefPtr<Gio::File>& destinationFile);
+    SaveReport save(const Glib::RefPtr<Gio::File>& destinationFile,
+                    const SaveOptions& options);
+
+    // Sinks for headless callers. Nothing goes through a temporary file,
+    // so writeNextToDestination doesn't apply. The descriptor, which may be
+    // a pipe or stdout, is left open.
+    SaveReport saveToBuffer(std::vector<unsigned char>& buffer,
+                            const SaveOptions& options);
+    SaveReport saveToDescriptor(int fileDescriptor,
+                                const SaveOptions& options);
+
+    // Writes several files out of a single parse of the inputs, several
+    // of them at the same time. Progress is reported as outputs finish.
+    SaveReport saveSplit(const std::vector<SplitOutput>& outputs,
+                         const SaveOptions& options);
+
+    // Parses the inputs of the next save ahead of time, on the calling
+    // thread, and drops the parsed files that no page refers to anymore.
+    // Only useful when SaveData::session is shared with that save.
+    // Does nothing while another saver uses the session.
+    void warmUp();
+
+    // Predicts the output from the sizes the kept pages declare for
+    // their streams, without reading or writing any stream data.
+    // Only inputs the session already parsed are looked into, and only
+    // while no other saver uses it. The others count with their whole
+    // size, as parsing them would cost about as much as the save.
+    SaveEstimate estimate(const SaveOptions& options);
 
 private:
     struct FileData {
@@ -33,9 +195,63 @@ private:
     };
 
     const SaveData m_saveData;
-    std::vector<FileData> m_filesData;
+    std::shared_ptr<Session> m_session;
+    std::vector<std::shared_ptr<FileData>> m_filesData;
+    std::unique_ptr<QPDF> m_scratchPDF;
+    // The first file, kept for m_scratchPDF to be written with its encryption
+    std::shared_ptr<FileData> m_encryptionSource;
+
+    void parseInputs();
+    std::vector<bool> referencedFiles() const;
+    void keepOnlyReferencedInputs() const;
+
+    static FileData parseFile(const Glib::RefPtr<Gio::File>& file);
+    static void loadAllPages(FileData& fileData);
+    static QPDFPageObjectHelper pageOf(FileData& fileData, unsigned int pageNumber);
+    static std::size_t estimateSize(FileData& fileData,
+                                    const std::vector<unsigned int>& pageNumbers,
+                                    SaveProfile profile);
+    static void recompressStreams(QPDF& pdf);
+    static SaveReport downsampleImages(QPDFPageDocumentHelper& pageDocumentHelper,
+                                       const SaveOptions& options);
+    static SaveReport deduplicateStreams(QPDF& pdf);
+
+    QPDF& outputPDF() const;
+    QPDF* encryptionSource() const;
+    bool isStreamed(const SaveOptions& options) const;
+    std::string cacheKey(const SaveOptions& options) const;
+    SaveReport saveThroughCache(const Glib::RefPtr<Gio::File>& destinationFile,
+                                const SaveOptions& options);
+    bool canSaveIncrementally(const SaveOptions& options) const;
+    bool writeIncrementally(const Glib::RefPtr<Gio::File>& destinationFile,
+                            const SaveOptions& options);
+    bool isSubsetOfFirstFile() const;
+    SaveReport buildOutput(const SaveOptions& options,
+                           const Glib::RefPtr<Gio::File>& spoolLocation = {});
+    std::unique_ptr<QPDF> buildOutputFromScratch(unsigned int firstPage,
+                                                 unsigned int lastPage,
+                                                 const SaveOptions& options,
+                                                 SaveReport& report);
+    std::unique_ptr<QPDF> buildStreamedOutput(const SaveOptions& options,
+                                              const Glib::RefPtr<Gio::File>& spoolLocation,
+                                              SaveReport& report);
+    static SaveReport optimizeOutput(QPDF& pdf,
+                                     QPDFPageDocumentHelper& pageDocumentHelper,
+                                     const SaveOptions& options);
 
-    void persist(const Glib::RefPtr<Gio::File>& destinationFile);
+    static void writeAtomically(const Glib::RefPtr<Gio::File>& destinationFile,
+                                const SaveOptions& options,
+                                const std::function<void(const Glib::RefPtr<Gio::File>&)>& writeTo);
+    // Outputs built from scratch take the encryption of encryptionSource,
+    // when it's encrypted. Outputs built from its shell keep it anyway.
+    static std::size_t writeToFile(QPDF& pdf,
+                                   const Glib::RefPtr<Gio::File>& destinationFile,
+                                   const SaveOptions& options,
+                                   QPDF* encryptionSource);
+    static std::size_t writeOutput(QPDF& pdf,
+                                   Pipeline& output,
+                                   const SaveOptions& options,
+                                   QPDF* encryptionSource);
 };
 
 } // namespace Slicer
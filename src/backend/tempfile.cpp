@@ -15,10 +15,17 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "tempfile.hpp"
+#include "ioexecutor.hpp"
 #include <config.hpp>
 #include <glibmm/miscutils.h>
+#include <stdexcept>
 #include <uuid.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace Slicer::TempFile {
 
 Glib::RefPtr<Gio::File> generate()
@@ -28,4 +35,74 @@ Glib::RefPtr<Gio::File> generate()
 
     return Gio::File::create_for_path(path);
 }
+
+// A hidden file in the same directory, so moving it over the file
+// is a rename instead of a copy
+Glib::RefPtr<Gio::File> generateNextTo(const Glib::RefPtr<Gio::File>& file)
+{
+    const std::string name = "." + file->get_basename() + "."
+                             + uuids::to_string(uuids::uuid_system_generator{}()) + ".tmp";
+
+    return file->get_parent()->get_child(name);
+}
+
+Glib::RefPtr<Gio::File> copyFrom(const Glib::RefPtr<Gio::File>& sourceFile)
+{
+    Glib::RefPtr<Gio::File> tempFile = generate();
+
+    IoExecutor::instance().run([&]() {
+        sourceFile->copy(tempFile, Gio::FILE_COPY_OVERWRITE);
+    });
+
+    return tempFile;
+}
+
+void moveTo(const Glib::RefPtr<Gio::File>& tempFile,
+            const Glib::RefPtr<Gio::File>& destinationFile)
+{
+    IoExecutor::instance().run([&]() {
+        tempFile->move(destinationFile, Gio::FILE_COPY_OVERWRITE);
+    });
+}
+
+// Flushes a file that was written by someone else, like the copy GIO
+// makes when a move crosses filesystems. Windows can only flush files
+// open for writing, and its copies are written through anyway.
+void syncFile([[maybe_unused]] const Glib::RefPtr<Gio::File>& file)
+{
+#ifndef _WIN32
+    IoExecutor::instance().run([&]() {
+        const int descriptor = open(file->get_path().c_str(), O_RDONLY);
+
+        if (descriptor < 0)
+            throw std::runtime_error("Couldn't open file: " + file->get_path());
+
+        const int result = fsync(descriptor);
+        close(descriptor);
+
+        if (result != 0)
+            throw std::runtime_error("Couldn't sync file: " + file->get_path());
+    });
+#endif
+}
+
+// Makes a rename inside the directory survive a crash.
+// Windows has no way to sync a directory, and doesn't need it.
+void syncDirectory([[maybe_unused]] const Glib::RefPtr<Gio::File>& directory)
+{
+#ifndef _WIN32
+    IoExecutor::instance().run([&]() {
+        const int descriptor = open(directory->get_path().c_str(), O_RDONLY | O_DIRECTORY);
+
+        if (descriptor < 0)
+            throw std::runtime_error("Couldn't open directory: " + directory->get_path());
+
+        const int result = fsync(descriptor);
+        close(descriptor);
+
+        if (result != 0)
+            throw std::runtime_error("Couldn't sync directory: " + directory->get_path());
+    });
+#endif
+}
 }
@@ -22,6 +22,12 @@
 namespace Slicer::TempFile {
 
 Glib::RefPtr<Gio::File> generate();
+Glib::RefPtr<Gio::File> generateNextTo(const Glib::RefPtr<Gio::File>& file);
+Glib::RefPtr<Gio::File> copyFrom(const Glib::RefPtr<Gio::File>& sourceFile);
+void moveTo(const Glib::RefPtr<Gio::File>& tempFile,
+            const Glib::RefPtr<Gio::File>& destinationFile);
+void syncFile(const Glib::RefPtr<Gio::File>& file);
+void syncDirectory(const Glib::RefPtr<Gio::File>& directory);
 }
 
 #endif // TEMPFILE_HPP
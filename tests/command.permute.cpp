@@ -0,0 +1,85 @@
+#include "common.hpp"
+#include <catch.hpp>
+#include <command.hpp>
+
+using namespace Slicer;
+
+static std::vector<unsigned int> indexesInFile(const Document& doc)
+{
+    std::vector<unsigned int> result;
+
+    for (unsigned int i = 0; i < doc.numberOfPages(); ++i)
+        result.push_back(doc.getPage(i)->indexInFile());
+
+    return result;
+}
+
+SCENARIO("Reordering all the pages of a document at once using the Command abstraction")
+{
+    GIVEN("A multipage document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        REQUIRE(doc.numberOfPages() == 15);
+
+        int itemsChangedCount = 0;
+        doc.pages()->signal_items_changed().connect([&itemsChangedCount](guint, guint, guint) {
+            ++itemsChangedCount;
+        });
+
+        WHEN("The pages are reversed")
+        {
+            PermutePagesCommand command{doc, PageOrder::reversed(doc.numberOfPages())};
+            command.execute();
+
+            THEN("The pages should be in reverse order, with a single notification")
+            {
+                REQUIRE(indexesInFile(doc) == std::vector<unsigned int>{14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0});
+                REQUIRE(itemsChangedCount == 1);
+            }
+
+            THEN("Every page should know its new position")
+            {
+                for (unsigned int i = 0; i < doc.numberOfPages(); ++i)
+                    REQUIRE(doc.getPage(i)->getDocumentIndex() == i);
+            }
+
+            WHEN("The command is undone")
+            {
+                command.undo();
+
+                THEN("The pages should be back in their original order")
+                REQUIRE(indexesInFile(doc) == std::vector<unsigned int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14});
+            }
+        }
+
+        WHEN("The pages are interleaved as duplex scans with reversed backs")
+        {
+            PermutePagesCommand command{doc, PageOrder::interleaved(doc.numberOfPages(), true)};
+            command.execute();
+
+            THEN("Every front should be followed by its back")
+            REQUIRE(indexesInFile(doc) == std::vector<unsigned int>{0, 14, 1, 13, 2, 12, 3, 11, 4, 10, 5, 9, 6, 8, 7});
+
+            WHEN("The pages are sorted by their source file")
+            {
+                PermutePagesCommand sortCommand{doc, PageOrder::sortedBySourceFile(doc)};
+                sortCommand.execute();
+
+                THEN("The pages should be back in their original order")
+                REQUIRE(indexesInFile(doc) == std::vector<unsigned int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14});
+            }
+        }
+
+        WHEN("An order that misses a page is applied")
+        {
+            std::vector<unsigned int> order = PageOrder::reversed(doc.numberOfPages());
+            order.back() = order.front();
+
+            THEN("The document should refuse it and stay as it was")
+            {
+                REQUIRE_THROWS(doc.permutePages(order));
+                REQUIRE(itemsChangedCount == 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,382 @@
+#include "common.hpp"
+#include <catch.hpp>
+#include <commandmanager.hpp>
+
+using namespace Slicer;
+
+class FailingCommand : public Command {
+public:
+    void execute() override { throw std::runtime_error("The command failed"); }
+    void undo() override { throw std::runtime_error("The command failed"); }
+    void redo() override { throw std::runtime_error("The command failed"); }
+};
+
+SCENARIO("Keeping the undo history within its limits")
+{
+    GIVEN("A multipage document with 15 pages and a command manager")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        CommandManager commandManager;
+
+        WHEN("The history is limited to 3 commands and 5 pages are removed one by one")
+        {
+            commandManager.setHistoryLimits(3, 1024 * 1024 * 1024);
+
+            for (int i = 0; i < 5; ++i)
+                commandManager.execute(std::make_shared<RemovePageCommand>(doc, 0));
+
+            THEN("Only the last 3 commands should be kept")
+            REQUIRE(commandManager.historyDepth() == 3);
+
+            THEN("Undoing everything that's kept should bring back 3 pages")
+            {
+                while (commandManager.canUndo())
+                    commandManager.undo();
+
+                REQUIRE(doc.numberOfPages() == 13);
+                REQUIRE(doc.getPage(0)->indexInFile() == 2);
+            }
+        }
+
+        WHEN("Pages are removed until the history goes over its memory budget")
+        {
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+            const std::size_t costOfOneRange = commandManager.historyCost();
+            commandManager.setHistoryLimits(100, costOfOneRange);
+
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+
+            THEN("The history should have forgotten the oldest command")
+            {
+                REQUIRE(commandManager.historyDepth() == 1);
+                REQUIRE(commandManager.historyCost() == costOfOneRange);
+            }
+        }
+
+        WHEN("A single command costs more than the whole budget")
+        {
+            commandManager.setHistoryLimits(100, 0);
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+
+            THEN("It should still be possible to undo it")
+            REQUIRE(commandManager.canUndo());
+        }
+
+        WHEN("Some pages are removed and the removal is undone")
+        {
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+            commandManager.undo();
+
+            THEN("The history should cost nothing, as the pages are back in the document")
+            REQUIRE(commandManager.historyCost() == 0);
+        }
+
+        WHEN("Removals are undone and redone, and a new command drops the one left to redo")
+        {
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+            const std::size_t costOfOneRange = commandManager.historyCost();
+
+            commandManager.undo();
+            commandManager.redo();
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+            const std::size_t costOfTwoRanges = commandManager.historyCost();
+
+            commandManager.undo();
+            commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{0}));
+
+            THEN("The history should cost what every removal still kept costs")
+            {
+                REQUIRE(costOfOneRange > 0);
+                REQUIRE(costOfTwoRanges == 2 * costOfOneRange);
+                REQUIRE(commandManager.historyCost() == costOfOneRange);
+            }
+        }
+
+        WHEN("A file is added")
+        {
+            commandManager.execute(std::make_shared<AddFilesCommand>(doc,
+                                                                     std::vector<Glib::RefPtr<Gio::File>>{Gio::File::create_for_path(multipage2Path)},
+                                                                     15));
+
+            THEN("The history should cost nothing, as the added pages are in the document")
+            REQUIRE(commandManager.historyCost() == 0);
+
+            WHEN("The addition is undone")
+            {
+                commandManager.undo();
+
+                THEN("The history should cost the added pages")
+                REQUIRE(commandManager.historyCost() > 0);
+            }
+        }
+    }
+}
+
+SCENARIO("Removing the copies of files the history no longer needs")
+{
+    GIVEN("A document made of two merged PDF files and a command manager")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        const PdfSaver::SaveData saveData = doc.getSaveData();
+
+        CommandManager commandManager;
+        commandManager.setHistoryLimits(1, 1024 * 1024 * 1024);
+
+        WHEN("The pages of the second file are removed, and the history forgets it")
+        {
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 15, 19));
+            commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{0}));
+            doc.releaseUnusedFiles();
+
+            THEN("The copy of the second file should be removed")
+            REQUIRE_FALSE(saveData.files.at(1)->query_exists());
+
+            THEN("The copy of the first file should be kept")
+            REQUIRE(saveData.files.at(0)->query_exists());
+        }
+
+        WHEN("The pages of the second file are removed, and the removal can still be undone")
+        {
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 15, 19));
+            doc.releaseUnusedFiles();
+
+            THEN("The copy of the second file should be kept")
+            REQUIRE(saveData.files.at(1)->query_exists());
+        }
+    }
+}
+
+SCENARIO("Folding repeated moves and rotations into a single undo step")
+{
+    GIVEN("A multipage document with 15 pages and a command manager")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        CommandManager commandManager;
+
+        WHEN("The first page is moved right one place at a time, 4 times")
+        {
+            for (unsigned int i = 0; i < 4; ++i)
+                commandManager.execute(std::make_shared<MovePageCommand>(doc, i, i + 1));
+
+            THEN("The first page of the file should be the 5th page of the document")
+            REQUIRE(doc.getPage(4)->indexInFile() == 0);
+
+            THEN("The moves should take a single step of the history")
+            REQUIRE(commandManager.historyDepth() == 1);
+
+            WHEN("The moves are undone")
+            {
+                commandManager.undo();
+
+                THEN("The first page of the file should be back in its place")
+                REQUIRE(doc.getPage(0)->indexInFile() == 0);
+
+                THEN("There should be nothing else to undo")
+                REQUIRE_FALSE(commandManager.canUndo());
+            }
+        }
+
+        WHEN("The first 3 pages are moved right one place at a time, twice")
+        {
+            commandManager.execute(std::make_shared<MovePageRangeCommand>(doc, 0, 2, 1));
+            commandManager.execute(std::make_shared<MovePageRangeCommand>(doc, 1, 3, 2));
+
+            THEN("The moves should take a single step of the history")
+            REQUIRE(commandManager.historyDepth() == 1);
+
+            THEN("Undoing them should bring back the original order")
+            {
+                commandManager.undo();
+
+                for (unsigned int i = 0; i < doc.numberOfPages(); ++i)
+                    REQUIRE(doc.getPage(i)->indexInFile() == i);
+            }
+        }
+
+        WHEN("The same pages are rotated right 3 times and left once")
+        {
+            for (int i = 0; i < 3; ++i)
+                commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{0, 2}));
+
+            commandManager.execute(std::make_shared<RotatePagesLeftCommand>(doc, std::vector<unsigned int>{0, 2}));
+
+            THEN("The pages should end up rotated 180 degrees in a single step of the history")
+            {
+                REQUIRE(doc.getPage(0)->currentRotation() == 180);
+                REQUIRE(doc.getPage(2)->currentRotation() == 180);
+                REQUIRE(commandManager.historyDepth() == 1);
+            }
+
+            THEN("Undoing them should bring back the original rotation")
+            {
+                commandManager.undo();
+
+                REQUIRE(doc.getPage(0)->currentRotation() == 0);
+                REQUIRE(doc.getPage(2)->currentRotation() == 0);
+            }
+        }
+
+        WHEN("The same pages are rotated right 4 times")
+        {
+            int pagesRotatedCount = 0;
+            doc.pagesRotated.connect([&pagesRotatedCount](const std::vector<unsigned int>&) {
+                ++pagesRotatedCount;
+            });
+
+            for (int i = 0; i < 4; ++i)
+                commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{0, 2}));
+
+            THEN("Undoing them should leave the pages alone, as they made a whole turn")
+            {
+                commandManager.undo();
+
+                REQUIRE(doc.getPage(0)->currentRotation() == 0);
+                REQUIRE(pagesRotatedCount == 4);
+            }
+
+            THEN("Undoing and redoing them should leave the pages alone too")
+            {
+                commandManager.undo();
+                commandManager.redo();
+
+                REQUIRE(pagesRotatedCount == 4);
+            }
+        }
+
+        WHEN("A page is moved, the move is undone and redone, and the page is moved again")
+        {
+            commandManager.execute(std::make_shared<MovePageCommand>(doc, 0, 1));
+            commandManager.undo();
+            commandManager.redo();
+            commandManager.execute(std::make_shared<MovePageCommand>(doc, 1, 2));
+
+            THEN("The new move should not be folded into the redone one")
+            REQUIRE(commandManager.historyDepth() == 2);
+        }
+    }
+}
+
+SCENARIO("Grouping several commands into a transaction")
+{
+    GIVEN("A multipage document with 15 pages and a command manager")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        CommandManager commandManager;
+
+        int itemsChangedCount = 0;
+        int pagesRotatedCount = 0;
+        int pagesReorderedCount = 0;
+        std::vector<unsigned int> rotatedPositions;
+
+        doc.pages()->signal_items_changed().connect([&itemsChangedCount](guint, guint, guint) {
+            ++itemsChangedCount;
+        });
+        doc.pagesRotated.connect([&](const std::vector<unsigned int>& positions) {
+            ++pagesRotatedCount;
+            rotatedPositions = positions;
+        });
+        doc.pagesReordered.connect([&pagesReorderedCount](const std::vector<unsigned int>&) {
+            ++pagesReorderedCount;
+        });
+
+        WHEN("The last 5 pages are removed one by one and 2 pages are rotated in a transaction")
+        {
+            commandManager.beginTransaction(doc);
+
+            for (unsigned int i = 14; i >= 10; --i)
+                commandManager.execute(std::make_shared<RemovePageCommand>(doc, i));
+
+            commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{0, 1}));
+
+            THEN("Nothing should be notified before the transaction is committed")
+            {
+                REQUIRE(itemsChangedCount == 0);
+                REQUIRE(pagesRotatedCount == 0);
+            }
+
+            commandManager.commitTransaction();
+
+            THEN("The document should be notified once of each kind of change")
+            {
+                REQUIRE(doc.numberOfPages() == 10);
+                REQUIRE(itemsChangedCount == 1);
+                REQUIRE(pagesRotatedCount == 1);
+                REQUIRE(rotatedPositions == std::vector<unsigned int>{0, 1});
+            }
+
+            THEN("The whole transaction should be undone in a single step")
+            {
+                commandManager.undo();
+
+                REQUIRE(doc.numberOfPages() == 15);
+                REQUIRE(doc.getPage(0)->currentRotation() == 0);
+                REQUIRE(itemsChangedCount == 2);
+                REQUIRE_FALSE(commandManager.canUndo());
+            }
+        }
+
+        WHEN("A transaction with a removal, a move and a rotation is rolled back")
+        {
+            commandManager.beginTransaction(doc);
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+            commandManager.execute(std::make_shared<MovePageCommand>(doc, 0, 3));
+            commandManager.execute(std::make_shared<RotatePagesRightCommand>(doc, std::vector<unsigned int>{1}));
+            commandManager.rollbackTransaction();
+
+            THEN("The document and the history should be left as they were")
+            {
+                REQUIRE(doc.numberOfPages() == 15);
+                REQUIRE(doc.getPage(0)->indexInFile() == 0);
+                REQUIRE(doc.getPage(6)->currentRotation() == 0);
+                REQUIRE_FALSE(commandManager.canUndo());
+            }
+
+            THEN("Nothing should be notified")
+            {
+                REQUIRE(itemsChangedCount == 0);
+                REQUIRE(pagesReorderedCount == 0);
+                REQUIRE(pagesRotatedCount == 0);
+            }
+        }
+
+        WHEN("A command of a transaction fails")
+        {
+            commandManager.beginTransaction(doc);
+            commandManager.execute(std::make_shared<RemovePageRangeCommand>(doc, 0, 4));
+
+            THEN("The transaction should be rolled back")
+            {
+                REQUIRE_THROWS(commandManager.execute(std::make_shared<FailingCommand>()));
+                REQUIRE(doc.numberOfPages() == 15);
+                REQUIRE(itemsChangedCount == 0);
+                REQUIRE_FALSE(commandManager.canUndo());
+                REQUIRE_NOTHROW(commandManager.beginTransaction(doc));
+            }
+        }
+
+        WHEN("A command fails while a composite command is undone")
+        {
+            auto removal = std::make_shared<RemovePageRangeCommand>(doc, 0, 4);
+            removal->execute();
+
+            CompositeCommand composite{doc};
+            composite.add(std::make_shared<FailingCommand>());
+            composite.add(removal);
+
+            THEN("The commands undone before it should be redone")
+            {
+                REQUIRE_THROWS(composite.undo());
+                REQUIRE(doc.numberOfPages() == 10);
+            }
+
+            THEN("The document should be out of the transaction")
+            {
+                REQUIRE_THROWS(composite.undo());
+
+                doc.rotatePagesRight({0});
+                REQUIRE(pagesRotatedCount == 1);
+            }
+        }
+    }
+}
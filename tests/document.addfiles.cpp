@@ -1,9 +1,72 @@
 #include "common.hpp"
 #include <catch.hpp>
+#include <deque>
 #include <document.hpp>
+#include <ioexecutor.hpp>
+#include <mutex>
+#include <thread>
 
 using namespace Slicer;
 
+// Stands in for the main loop: scheduled functions wait in a queue
+// until the test thread runs them
+class QueuedScheduler {
+public:
+    Scheduler scheduler()
+    {
+        return [this](std::function<void()> function) {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_functions.push_back(std::move(function));
+        };
+    }
+
+    template <typename T>
+    void runUntilReady(const Future<T>& future)
+    {
+        while (!future.isReady()) {
+            std::function<void()> function;
+
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+
+                if (!m_functions.empty()) {
+                    function = std::move(m_functions.front());
+                    m_functions.pop_front();
+                }
+            }
+
+            if (function)
+                function();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Runs what's queued, including what those functions queue
+    void runPending()
+    {
+        while (true) {
+            std::function<void()> function;
+
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+
+                if (m_functions.empty())
+                    return;
+
+                function = std::move(m_functions.front());
+                m_functions.pop_front();
+            }
+
+            function();
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<std::function<void()>> m_functions;
+};
+
 SCENARIO("Adding 2 new files to an existing document")
 {
     GIVEN("A multipage PDF document with 15 pages")
@@ -153,5 +216,131 @@ SCENARIO("Adding 2 new files to an existing document")
                 REQUIRE(doc.getPage(34)->fileName() == multipage1Name);
             }
         }
+
+        WHEN("Many files are added at once")
+        {
+            std::vector<Glib::RefPtr<Gio::File>> manyFiles;
+
+            for (int i = 0; i < 10; ++i)
+                manyFiles.insert(manyFiles.end(), filesToAdd.begin(), filesToAdd.end());
+
+            const unsigned int numberOfAddedPages = doc.addFiles(manyFiles, 15);
+
+            THEN("The document should now have 215 pages")
+            {
+                REQUIRE(numberOfAddedPages == 200);
+                REQUIRE(doc.numberOfPages() == 215);
+            }
+
+            THEN("The files should be spliced in the order they were given, even if they're loaded in parallel")
+            {
+                for (unsigned int i = 0; i < 10; ++i) {
+                    const unsigned int firstPage = 15 + i * 20;
+
+                    REQUIRE(doc.getPage(firstPage)->fileName() == multipage2Name);
+                    REQUIRE(doc.getPage(firstPage + 5)->fileName() == multipage3Name);
+                    REQUIRE(doc.getPage(firstPage + 19)->indexInFile() == 14);
+                }
+            }
+
+            THEN("Document indexes should be monotonically increasing")
+            {
+                for (unsigned int i = 0; i < doc.numberOfPages(); ++i)
+                    REQUIRE(doc.getPage(i)->getDocumentIndex() == i);
+            }
+        }
+    }
+}
+
+SCENARIO("Adding files while the main loop keeps running")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        QueuedScheduler mainLoop;
+
+        const std::vector<Glib::RefPtr<Gio::File>> filesToAdd = {
+            Gio::File::create_for_path(multipage2Path),
+            Gio::File::create_for_path(multipage3Path)};
+
+        WHEN("Two PDF files (5 and 15 pages) are added after the 4th page")
+        {
+            Future<unsigned int> added = doc.addFiles(filesToAdd, 4, mainLoop.scheduler());
+            mainLoop.runUntilReady(added);
+
+            THEN("Every page of both files should be added")
+            {
+                REQUIRE(added.get() == 20);
+                REQUIRE(doc.numberOfPages() == 35);
+            }
+
+            THEN("The files should be spliced in the order they were given")
+            {
+                REQUIRE(doc.getPage(4)->fileName() == multipage2Name);
+                REQUIRE(doc.getPage(9)->fileName() == multipage3Name);
+                REQUIRE(doc.getPage(24)->fileName() == multipage1Name);
+            }
+
+            THEN("Document indexes should be monotonically increasing")
+            {
+                for (unsigned int i = 0; i < doc.numberOfPages(); ++i)
+                    REQUIRE(doc.getPage(i)->getDocumentIndex() == i);
+            }
+        }
+
+        WHEN("One of the files can't be loaded")
+        {
+            std::vector<Glib::RefPtr<Gio::File>> files = filesToAdd;
+            files.push_back(Gio::File::create_for_path("missing.pdf"));
+
+            Future<unsigned int> added = doc.addFiles(files, 0, mainLoop.scheduler());
+            mainLoop.runUntilReady(added);
+
+            THEN("The failure should reach the caller")
+            REQUIRE_THROWS(added.get());
+
+            THEN("The pages of the other files should be taken out again")
+            {
+                REQUIRE(doc.numberOfPages() == 15);
+                REQUIRE(doc.getPage(0)->fileName() == multipage1Name);
+            }
+        }
+
+        WHEN("Another document is destroyed while its files are loading")
+        {
+            auto otherDoc = std::make_unique<Document>(Gio::File::create_for_path(multipage1Path));
+            Future<unsigned int> added = otherDoc->addFiles(filesToAdd, 0, mainLoop.scheduler());
+            otherDoc.reset();
+
+            THEN("The addition should be canceled")
+            REQUIRE_THROWS_AS(added.get(), TaskCanceled);
+
+            THEN("The loads that finish afterwards should be dropped")
+            {
+                IoExecutor::instance().waitUntilAllTasksFinish();
+                REQUIRE_NOTHROW(mainLoop.runPending());
+            }
+        }
+    }
+}
+
+SCENARIO("Adding files when one of them can't be loaded")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        WHEN("A valid file and a missing one are added")
+        {
+            const std::vector<Glib::RefPtr<Gio::File>> files = {
+                Gio::File::create_for_path(multipage2Path),
+                Gio::File::create_for_path("missing.pdf")};
+
+            THEN("The failure should be rethrown and no page should be added")
+            {
+                REQUIRE_THROWS(doc.addFiles(files, 0));
+                REQUIRE(doc.numberOfPages() == 15);
+            }
+        }
     }
 }
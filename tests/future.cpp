@@ -0,0 +1,180 @@
+#include <catch.hpp>
+#include <future.hpp>
+#include <ioexecutor.hpp>
+#include <thread>
+
+using namespace Slicer;
+
+SCENARIO("Chaining typed continuations on futures")
+{
+    GIVEN("A promise for an integer")
+    {
+        Promise<int> promise;
+        Future<int> future = promise.future();
+
+        WHEN("A continuation is chained and the value is set")
+        {
+            Future<std::string> chained = future.then(runInline, [](int value) {
+                return std::to_string(value * 2);
+            });
+
+            promise.setValue(21);
+
+            THEN("The continuation should receive the value")
+            REQUIRE(chained.get() == "42");
+        }
+
+        WHEN("The promise fails")
+        {
+            bool continuationRan = false;
+            Future<void> chained = future.then(runInline, [&continuationRan](int) {
+                continuationRan = true;
+            });
+
+            promise.setException(std::make_exception_ptr(std::runtime_error{"Parsing failed"}));
+
+            THEN("The continuation should be skipped")
+            REQUIRE_FALSE(continuationRan);
+
+            THEN("The exception should propagate down the chain")
+            REQUIRE_THROWS_AS(chained.get(), std::runtime_error);
+        }
+
+        WHEN("The future is canceled before it completes")
+        {
+            bool handlerRan = false;
+            future.onCancel([&handlerRan]() {
+                handlerRan = true;
+            });
+            Future<int> chained = future.then(runInline, [](int value) {
+                return value;
+            });
+
+            future.cancel();
+            promise.setValue(1);
+
+            THEN("The cancel handlers should run")
+            REQUIRE(handlerRan);
+
+            THEN("Every chained future should be canceled too")
+            {
+                REQUIRE(chained.isCanceled());
+                REQUIRE_THROWS_AS(chained.get(), TaskCanceled);
+            }
+        }
+
+        WHEN("The future is canceled after the value is set")
+        {
+            bool handlerRan = false;
+            future.onCancel([&handlerRan]() {
+                handlerRan = true;
+            });
+            Future<int> chained = future.then(runInline, [](int value) {
+                return value * 2;
+            });
+
+            promise.setValue(21);
+            future.cancel();
+
+            THEN("The value should win")
+            {
+                REQUIRE_FALSE(future.isCanceled());
+                REQUIRE(chained.get() == 42);
+            }
+
+            THEN("The cancel handlers should not run")
+            REQUIRE_FALSE(handlerRan);
+        }
+
+        WHEN("The value is set by another thread while the future is canceled")
+        {
+            Future<int> chained = future.then(runInline, [](int value) {
+                return value;
+            });
+
+            std::thread producer{[&promise]() {
+                promise.setValue(1);
+            }};
+            future.cancel();
+            producer.join();
+
+            THEN("The chained future should either get the value or be canceled")
+            {
+                if (future.isCanceled())
+                    REQUIRE_THROWS_AS(chained.get(), TaskCanceled);
+                else
+                    REQUIRE(chained.get() == 1);
+            }
+        }
+    }
+
+    GIVEN("A default constructed future")
+    {
+        Future<int> future;
+
+        THEN("It should be invalid and never ready")
+        {
+            REQUIRE_FALSE(future.isValid());
+            REQUIRE_FALSE(future.isReady());
+            REQUIRE_FALSE(future.isCanceled());
+        }
+
+        THEN("Canceling it should do nothing")
+        REQUIRE_NOTHROW(future.cancel());
+
+        THEN("Waiting on it should throw")
+        {
+            REQUIRE_THROWS_AS(future.wait(), std::runtime_error);
+            REQUIRE_THROWS_AS(future.get(), std::runtime_error);
+        }
+    }
+
+    GIVEN("Several independent operations on the I/O executor")
+    {
+        auto ioScheduler = [](std::function<void()> function) {
+            (void) IoExecutor::instance().submit(std::move(function));
+        };
+
+        std::vector<Future<int>> futures;
+
+        for (int i = 1; i <= 5; ++i) {
+            Promise<void> start;
+            futures.push_back(start.future().then(ioScheduler, [i]() {
+                return i * i;
+            }));
+            start.setValue();
+        }
+
+        WHEN("Waiting for all of them")
+        {
+            const std::vector<int> results = whenAll(futures).get();
+
+            THEN("The results should keep the order of the inputs")
+            REQUIRE(results == std::vector<int>{1, 4, 9, 16, 25});
+        }
+    }
+
+    GIVEN("Two futures, one of which never completes")
+    {
+        Promise<int> done;
+        Promise<int> pending;
+        Future<std::vector<int>> all = whenAll(std::vector<Future<int>>{done.future(), pending.future()});
+
+        WHEN("Only the first one completes")
+        {
+            done.setValue(1);
+
+            THEN("The combined future should stay pending")
+            REQUIRE_FALSE(all.isReady());
+        }
+
+        WHEN("The pending future fails")
+        {
+            done.setValue(1);
+            pending.setException(std::make_exception_ptr(std::runtime_error{"Parsing failed"}));
+
+            THEN("The combined future should fail too")
+            REQUIRE_THROWS_AS(all.get(), std::runtime_error);
+        }
+    }
+}
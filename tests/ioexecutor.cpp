@@ -0,0 +1,128 @@
+#include <catch.hpp>
+#include <ioexecutor.hpp>
+#include <thread>
+
+using namespace Slicer;
+
+// The executor is shared by every test,
+// so a changed concurrency limit is put back afterwards
+class ConcurrencyGuard {
+public:
+    ConcurrencyGuard(IoExecutor& executor)
+        : m_executor{executor}
+        , m_previousConcurrency{executor.maxConcurrency()}
+    {
+    }
+
+    ConcurrencyGuard(const ConcurrencyGuard&) = delete;
+    ConcurrencyGuard& operator=(const ConcurrencyGuard&) = delete;
+
+    ~ConcurrencyGuard()
+    {
+        m_executor.setMaxConcurrency(m_previousConcurrency);
+    }
+
+private:
+    IoExecutor& m_executor;
+    const int m_previousConcurrency;
+};
+
+SCENARIO("File operations run on the I/O executor")
+{
+    GIVEN("The application-wide I/O executor")
+    {
+        IoExecutor& executor = IoExecutor::instance();
+        const ConcurrencyGuard concurrencyGuard{executor};
+
+        WHEN("An operation that returns a value is run")
+        {
+            const int result = executor.run([]() {
+                return 42;
+            });
+
+            THEN("The value should be handed back to the caller")
+            REQUIRE(result == 42);
+        }
+
+        WHEN("An operation that throws is run")
+        {
+            THEN("The exception should be rethrown in the caller's thread")
+            REQUIRE_THROWS_AS(executor.run([]() -> int {
+                                  throw std::runtime_error("Couldn't read file");
+                              }),
+                              std::runtime_error);
+        }
+
+        WHEN("An operation is run from inside another I/O operation")
+        {
+            executor.setMaxConcurrency(1);
+
+            const bool ranOnIoThread = executor.submit([&executor]() {
+                                                   return executor.run([]() {
+                                                       return IoExecutor::isIoThread();
+                                                   });
+                                               })
+                                           .get();
+
+            THEN("It should run inline instead of deadlocking the pool")
+            REQUIRE(ranOnIoThread);
+        }
+
+        WHEN("An operation is run while every thread of the pool is busy")
+        {
+            executor.setMaxConcurrency(1);
+
+            std::promise<void> release;
+            std::future<void> background = executor.submit([released = release.get_future()]() {
+                released.wait();
+            });
+
+            const std::thread::id callerThread = std::this_thread::get_id();
+            const std::thread::id operationThread = executor.run([]() {
+                return std::this_thread::get_id();
+            });
+
+            release.set_value();
+            background.get();
+
+            THEN("It should run right away in the calling thread")
+            REQUIRE(operationThread == callerThread);
+        }
+
+        WHEN("Independent operations are spread across the pool from an I/O thread")
+        {
+            executor.setMaxConcurrency(2);
+
+            std::vector<int> squares(50);
+            executor.run([&executor, &squares]() {
+                executor.parallelFor(squares.size(), [&squares](std::size_t i) {
+                    squares.at(i) = static_cast<int>(i * i);
+                });
+            });
+
+            THEN("Every index should be processed exactly once")
+            {
+                for (std::size_t i = 0; i < squares.size(); ++i)
+                    REQUIRE(squares.at(i) == static_cast<int>(i * i));
+            }
+
+            THEN("A failing operation should be rethrown to the caller")
+            REQUIRE_THROWS_AS(executor.parallelFor(10, [](std::size_t i) {
+                                  if (i == 7)
+                                      throw std::runtime_error("Couldn't parse file");
+                              }),
+                              std::runtime_error);
+        }
+
+        WHEN("The concurrency limit is changed")
+        {
+            executor.setMaxConcurrency(3);
+
+            THEN("The executor should report the new limit")
+            REQUIRE(executor.maxConcurrency() == 3);
+
+            THEN("Asking for no threads at all should be rejected")
+            REQUIRE_THROWS(executor.setMaxConcurrency(0));
+        }
+    }
+}
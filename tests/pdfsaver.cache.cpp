@@ -0,0 +1,74 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Saving the same slice twice through the output cache")
+{
+    GIVEN("A document made of two merged PDF files and a cache directory")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        doc.removePageRange(3, 12);
+        doc.rotatePagesRight({1});
+
+        const ScratchFile cacheDirectory;
+        PdfSaver::SaveOptions options;
+        options.cacheDirectory = cacheDirectory;
+
+        WHEN("The document is saved twice")
+        {
+            const ScratchFile firstFile;
+            const ScratchFile secondFile;
+            const PdfSaver::SaveReport firstReport = PdfSaver{doc.getSaveData()}.save(firstFile, options);
+            const PdfSaver::SaveReport secondReport = PdfSaver{doc.getSaveData()}.save(secondFile, options);
+
+            THEN("Only the second save should come from the cache")
+            {
+                REQUIRE_FALSE(firstReport.isCached);
+                REQUIRE(secondReport.isCached);
+            }
+
+            THEN("Both outputs should be identical")
+            {
+                REQUIRE(contentsOf(firstFile) == contentsOf(secondFile));
+            }
+        }
+
+        WHEN("The same files are opened again, with the same changes, and both documents are saved")
+        {
+            Document reopenedDoc{Gio::File::create_for_path(multipage1Path)};
+            reopenedDoc.addFile(Gio::File::create_for_path(multipage2Path), reopenedDoc.numberOfPages());
+            reopenedDoc.removePageRange(3, 12);
+            reopenedDoc.rotatePagesRight({1});
+
+            const ScratchFile firstFile;
+            const ScratchFile secondFile;
+            const PdfSaver::SaveReport firstReport = PdfSaver{doc.getSaveData()}.save(firstFile, options);
+            const PdfSaver::SaveReport secondReport = PdfSaver{reopenedDoc.getSaveData()}.save(secondFile, options);
+
+            THEN("The save of the reopened document should come from the cache")
+            {
+                REQUIRE_FALSE(firstReport.isCached);
+                REQUIRE(secondReport.isCached);
+            }
+        }
+
+        WHEN("The document is saved deterministically twice, without the cache")
+        {
+            PdfSaver::SaveOptions deterministicOptions;
+            deterministicOptions.deterministic = true;
+
+            const ScratchFile firstFile;
+            const ScratchFile secondFile;
+            PdfSaver{doc.getSaveData()}.save(firstFile, deterministicOptions);
+            PdfSaver{doc.getSaveData()}.save(secondFile, deterministicOptions);
+
+            THEN("Both outputs should be identical")
+            {
+                REQUIRE(contentsOf(firstFile) == contentsOf(secondFile));
+            }
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef SLICER_PDFSAVER_COMMON_HPP
+#define SLICER_PDFSAVER_COMMON_HPP
+
+#include <cstring>
+#include <document.hpp>
+#include <giomm/fileenumerator.h>
+#include <tempfile.hpp>
+#include <qpdf/BufferInputSource.hh>
+#include <qpdf/QPDF.hh>
+
+// A file or directory in the temporary directory, removed along with
+// everything in it once the test is done with it
+class ScratchFile {
+public:
+    ScratchFile()
+        : m_file{Slicer::TempFile::generate()}
+    {
+    }
+
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+
+    ~ScratchFile()
+    {
+        try {
+            removeRecursively(m_file);
+        }
+        catch (...) {
+        }
+    }
+
+    operator const Glib::RefPtr<Gio::File>&() const { return m_file; }
+    Gio::File* operator->() const { return m_file.operator->(); }
+
+private:
+    Glib::RefPtr<Gio::File> m_file;
+
+    static void removeRecursively(const Glib::RefPtr<Gio::File>& file)
+    {
+        if (!file->query_exists())
+            return;
+
+        if (file->query_file_type() == Gio::FILE_TYPE_DIRECTORY) {
+            Glib::RefPtr<Gio::FileEnumerator> children = file->enumerate_children();
+
+            for (Glib::RefPtr<Gio::FileInfo> child = children->next_file(); child; child = children->next_file())
+                removeRecursively(file->get_child(child->get_name()));
+        }
+
+        file->remove();
+    }
+};
+
+inline std::string contentsOf(const Glib::RefPtr<Gio::File>& file)
+{
+    char* contents = nullptr;
+    gsize length = 0;
+    file->load_contents(contents, length);
+    const std::string result{contents, length};
+    g_free(contents);
+
+    return result;
+}
+
+// Parses a copy of the file kept in memory, so the file itself
+// can be removed while the result is still in use
+inline std::unique_ptr<QPDF> openInMemory(const Glib::RefPtr<Gio::File>& file)
+{
+    const std::string contents = contentsOf(file);
+    auto buffer = new Buffer{contents.size()};
+    std::memcpy(buffer->getBuffer(), contents.data(), contents.size());
+
+    auto result = std::make_unique<QPDF>();
+    result->processInputSource(PointerHolder<InputSource>{new BufferInputSource{file->get_path(), buffer, true}});
+
+    return result;
+}
+
+inline std::unique_ptr<QPDF> saveAndOpen(const Slicer::Document& doc, const Slicer::PdfSaver::SaveOptions& options)
+{
+    const ScratchFile destinationFile;
+    Slicer::PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+    return openInMemory(destinationFile);
+}
+
+// Page dictionaries left in the file, whether its page tree reaches them or not
+inline std::size_t numberOfPageObjects(QPDF& pdf)
+{
+    std::size_t result = 0;
+
+    for (QPDFObjectHandle& object : pdf.getAllObjects()) {
+        if (object.isDictionary() && object.getKey("/Type").isName()
+            && object.getKey("/Type").getName() == "/Page")
+            ++result;
+    }
+
+    return result;
+}
+
+// The names of the files in a directory
+inline std::vector<std::string> childrenOf(const Glib::RefPtr<Gio::File>& directory)
+{
+    std::vector<std::string> result;
+    Glib::RefPtr<Gio::FileEnumerator> children = directory->enumerate_children();
+
+    for (Glib::RefPtr<Gio::FileInfo> child = children->next_file(); child; child = children->next_file())
+        result.push_back(child->get_name());
+
+    return result;
+}
+
+#endif // SLICER_PDFSAVER_COMMON_HPP
@@ -0,0 +1,49 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Merging a file with itself")
+{
+    GIVEN("A document made of the same PDF file twice")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage1Path), doc.numberOfPages());
+
+        PdfSaver::SaveOptions options;
+
+        WHEN("It's saved with the compact profile")
+        {
+            options.profile = PdfSaver::SaveProfile::Compact;
+
+            const ScratchFile destinationFile;
+            const PdfSaver::SaveReport report = PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            THEN("The streams of the second copy should be merged into those of the first")
+            {
+                REQUIRE(report.deduplicatedStreams > 0);
+                REQUIRE(report.bytesSaved > 0);
+            }
+
+            THEN("The saved file should still have every page")
+            {
+                QPDF saved;
+                saved.processFile(destinationFile->get_path().c_str());
+
+                REQUIRE(saved.getAllPages().size() == 30);
+            }
+        }
+
+        WHEN("It's saved with the balanced profile")
+        {
+            options.profile = PdfSaver::SaveProfile::Balanced;
+
+            const ScratchFile destinationFile;
+            const PdfSaver::SaveReport report = PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            THEN("No stream should be merged")
+            REQUIRE(report.deduplicatedStreams == 0);
+        }
+    }
+}
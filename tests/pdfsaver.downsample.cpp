@@ -0,0 +1,42 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Downsampling the images of a document")
+{
+    GIVEN("A PDF document with a page sized image")
+    {
+        Document doc{Gio::File::create_for_path(multipage3Path)};
+
+        PdfSaver::SaveOptions options;
+        options.imageResolution = 50;
+
+        WHEN("It's saved with a low image resolution")
+        {
+            const ScratchFile destinationFile;
+            const PdfSaver::SaveReport report = PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            QPDF saved;
+            saved.processFile(destinationFile->get_path().c_str());
+
+            THEN("The report should tell about the downsampled image")
+            {
+                REQUIRE(report.downsampledImages > 0);
+                REQUIRE(report.imageBytesSaved > 0);
+            }
+
+            THEN("No image should be wider than the resolution allows")
+            {
+                for (QPDFObjectHandle& object : saved.getAllObjects()) {
+                    if (!object.isStream() || !object.getDict().getKey("/Subtype").isName()
+                        || object.getDict().getKey("/Subtype").getName() != "/Image")
+                        continue;
+
+                    REQUIRE(object.getDict().getKey("/Width").getIntValue() < 794);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+#include <qpdf/QPDFWriter.hh>
+
+using namespace Slicer;
+
+SCENARIO("Keeping the encryption of the first file")
+{
+    GIVEN("A multipage PDF document with 15 pages, encrypted without a user password")
+    {
+        QPDF original;
+        original.processFile(multipage1Path.c_str());
+
+        const ScratchFile originalFile;
+        QPDFWriter writer{original, originalFile->get_path().c_str()};
+        writer.setR4EncryptionParameters("", "owner", true, true, true, true, true, true, qpdf_r3p_full, true, true);
+        writer.write();
+
+        Document doc{originalFile};
+
+        WHEN("Only 3 of its pages are kept")
+        {
+            doc.removePageRange(3, 14);
+
+            THEN("The saved file should be encrypted")
+            REQUIRE(saveAndOpen(doc, PdfSaver::SaveOptions{})->isEncrypted());
+
+            THEN("The saved file should be encrypted even when saved deterministically")
+            {
+                PdfSaver::SaveOptions options;
+                options.deterministic = true;
+
+                REQUIRE(saveAndOpen(doc, options)->isEncrypted());
+            }
+        }
+
+        WHEN("It's merged with another file with streamed inputs")
+        {
+            doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+
+            PdfSaver::SaveOptions options;
+            options.streamInputs = true;
+
+            std::unique_ptr<QPDF> saved = saveAndOpen(doc, options);
+
+            THEN("The saved file should be encrypted and have every page")
+            {
+                REQUIRE(saved->isEncrypted());
+                REQUIRE(saved->getAllPages().size() == doc.numberOfPages());
+            }
+        }
+
+        WHEN("It's split into 3 files of 5 pages")
+        {
+            const ScratchFile firstFile;
+            const ScratchFile secondFile;
+            const ScratchFile thirdFile;
+            const std::vector<PdfSaver::SplitOutput> outputs = {{0, 4, firstFile},
+                                                                {5, 9, secondFile},
+                                                                {10, 14, thirdFile}};
+            PdfSaver{doc.getSaveData()}.saveSplit(outputs, PdfSaver::SaveOptions{});
+
+            THEN("Every file should be encrypted")
+            {
+                for (const PdfSaver::SplitOutput& output : outputs)
+                    REQUIRE(openInMemory(output.destinationFile)->isEncrypted());
+            }
+        }
+    }
+}
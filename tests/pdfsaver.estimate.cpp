@@ -0,0 +1,48 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Estimating a save before doing it")
+{
+    GIVEN("A document made of two merged PDF files")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        doc.removePageRange(3, 12);
+
+        PdfSaver::SaveOptions options;
+
+        WHEN("The output is estimated and then saved")
+        {
+            const PdfSaver::SaveEstimate estimate = PdfSaver{doc.getSaveData()}.estimate(options);
+
+            const ScratchFile destinationFile;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+            const auto savedSize = static_cast<std::size_t>(destinationFile->query_info()->get_size());
+
+            THEN("The estimated size should be in the order of the saved one")
+            {
+                REQUIRE(estimate.bytes > savedSize / 4);
+                REQUIRE(estimate.bytes < savedSize * 4);
+            }
+        }
+
+        WHEN("The inputs are parsed ahead, then the output is estimated and saved")
+        {
+            PdfSaver{doc.getSaveData()}.warmUp();
+            const PdfSaver::SaveEstimate estimate = PdfSaver{doc.getSaveData()}.estimate(options);
+
+            const ScratchFile destinationFile;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+            const auto savedSize = static_cast<std::size_t>(destinationFile->query_info()->get_size());
+
+            THEN("The estimated size should be in the order of the saved one")
+            {
+                REQUIRE(estimate.bytes > savedSize / 4);
+                REQUIRE(estimate.bytes < savedSize * 4);
+            }
+        }
+    }
+}
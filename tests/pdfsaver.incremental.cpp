@@ -0,0 +1,69 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Saving only the page order and rotation as an incremental update")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Glib::RefPtr<Gio::File> sourceFile = Gio::File::create_for_path(multipage1Path);
+        Document doc{sourceFile};
+
+        PdfSaver::SaveOptions options;
+        options.incremental = true;
+
+        WHEN("Its pages are reordered and rotated")
+        {
+            doc.movePage(0, 7);
+            doc.rotatePagesRight({3});
+
+            const ScratchFile destinationFile;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            QPDF saved;
+            saved.processFile(destinationFile->get_path().c_str());
+
+            THEN("The saved file should have every page")
+            {
+                REQUIRE(saved.getAllPages().size() == 15);
+            }
+
+            THEN("The rotated page should keep its rotation")
+            {
+                REQUIRE(saved.getAllPages().at(3).getKey("/Rotate").getIntValue() == 90);
+            }
+
+            THEN("The saved file should only be slightly bigger than the original")
+            {
+                const goffset originalSize = sourceFile->query_info()->get_size();
+                const goffset savedSize = destinationFile->query_info()->get_size();
+
+                REQUIRE(savedSize > originalSize);
+                REQUIRE(savedSize - originalSize < 64 * 1024);
+            }
+        }
+
+        WHEN("One of its pages is removed")
+        {
+            doc.removePage(14);
+
+            const ScratchFile destinationFile;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            QPDF saved;
+            saved.processFile(destinationFile->get_path().c_str());
+
+            THEN("The saved file should have the remaining pages")
+            {
+                REQUIRE(saved.getAllPages().size() == 14);
+            }
+
+            THEN("The removed page should not be left in the saved file")
+            {
+                REQUIRE(numberOfPageObjects(saved) == 14);
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Saving a linearized document")
+{
+    GIVEN("A document made of two merged PDF files")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+
+        PdfSaver::SaveOptions options;
+        options.linearize = true;
+
+        WHEN("Some pages are reordered and rotated")
+        {
+            doc.movePage(0, 7);
+            doc.movePageRange(16, 18, 2);
+            doc.rotatePagesRight({0, 3, 16});
+            doc.rotatePagesLeft({5});
+            doc.removePage(10);
+
+            THEN("Every save profile should produce a linearized file with valid hint tables")
+            {
+                for (const auto profile : {PdfSaver::SaveProfile::Fast,
+                                           PdfSaver::SaveProfile::Balanced,
+                                           PdfSaver::SaveProfile::Compact}) {
+                    options.profile = profile;
+                    std::unique_ptr<QPDF> saved = saveAndOpen(doc, options);
+
+                    REQUIRE(saved->isLinearized());
+                    REQUIRE(saved->checkLinearization());
+                    REQUIRE(saved->getAllPages().size() == doc.numberOfPages());
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Saving a document without linearization")
+{
+    GIVEN("A multipage PDF document")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        WHEN("It's saved with the default options")
+        {
+            std::unique_ptr<QPDF> saved = saveAndOpen(doc, PdfSaver::SaveOptions{});
+
+            THEN("The saved file should not be linearized")
+            REQUIRE_FALSE(saved->isLinearized());
+        }
+    }
+}
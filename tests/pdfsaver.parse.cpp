@@ -0,0 +1,77 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+#include <ioexecutor.hpp>
+#include <thread>
+
+using namespace Slicer;
+
+SCENARIO("Parsing the inputs of a save in parallel")
+{
+    GIVEN("A document made of three merged PDF files")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        doc.addFile(Gio::File::create_for_path(multipage3Path), 4);
+        doc.movePage(0, 20);
+        doc.rotatePagesRight({2});
+
+        // Without a session, every save parses its inputs again
+        PdfSaver::SaveData saveData = doc.getSaveData();
+        saveData.session = nullptr;
+
+        PdfSaver::SaveOptions options;
+        options.deterministic = true;
+
+        WHEN("It's saved once parsing one input at a time, and once parsing them all at once")
+        {
+            IoExecutor& executor = IoExecutor::instance();
+            const int previousConcurrency = executor.maxConcurrency();
+
+            const ScratchFile sequentialFile;
+            executor.setMaxConcurrency(1);
+            PdfSaver{saveData}.save(sequentialFile, options);
+
+            const ScratchFile parallelFile;
+            executor.setMaxConcurrency(3);
+            PdfSaver{saveData}.save(parallelFile, options);
+
+            executor.setMaxConcurrency(previousConcurrency);
+
+            THEN("Both outputs should be identical")
+            REQUIRE(contentsOf(sequentialFile) == contentsOf(parallelFile));
+        }
+    }
+}
+
+SCENARIO("Saving from several threads with the same session")
+{
+    GIVEN("A document made of two merged PDF files")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        doc.rotatePagesRight({2, 17});
+
+        PdfSaver::SaveOptions options;
+        options.deterministic = true;
+
+        WHEN("It's saved, warmed up and estimated from several threads at once")
+        {
+            const PdfSaver::SaveData saveData = doc.getSaveData();
+            const ScratchFile firstFile;
+            const ScratchFile secondFile;
+
+            std::thread firstSave{[&]() { PdfSaver{saveData}.save(firstFile, options); }};
+            std::thread warmUp{[&]() { PdfSaver{saveData}.warmUp(); }};
+            std::thread estimate{[&]() { PdfSaver{saveData}.estimate(options); }};
+            PdfSaver{saveData}.save(secondFile, options);
+
+            firstSave.join();
+            warmUp.join();
+            estimate.join();
+
+            THEN("Both outputs should be identical")
+            REQUIRE(contentsOf(firstFile) == contentsOf(secondFile));
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Following and canceling a save")
+{
+    GIVEN("A document made of two merged PDF files and an empty destination directory")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+
+        const ScratchFile directory;
+        directory->make_directory();
+        Glib::RefPtr<Gio::File> destinationFile = directory->get_child("output.pdf");
+
+        std::vector<PdfSaver::SaveProgress> progress;
+        PdfSaver::SaveOptions options;
+        options.onProgress = [&progress](const PdfSaver::SaveProgress& saveProgress) {
+            progress.push_back(saveProgress);
+        };
+
+        WHEN("It's saved")
+        {
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            THEN("Progress should be reported up to the end")
+            {
+                REQUIRE_FALSE(progress.empty());
+                REQUIRE(progress.back().percentage == 100);
+                REQUIRE(progress.back().bytesWritten > 0);
+            }
+
+            THEN("The reported percentages should never go back")
+            {
+                for (std::size_t i = 1; i < progress.size(); ++i)
+                    REQUIRE(progress.at(i).percentage >= progress.at(i - 1).percentage);
+            }
+        }
+
+        WHEN("It's canceled after part of the output was written")
+        {
+            // Cancellation is polled before every write of the output,
+            // so this is well into the writing
+            auto numberOfPolls = std::make_shared<int>(0);
+            options.isCanceled = [numberOfPolls]() {
+                return ++(*numberOfPolls) > 50;
+            };
+
+            THEN("The save should throw TaskCanceled")
+            REQUIRE_THROWS_AS(PdfSaver{doc.getSaveData()}.save(destinationFile, options), TaskCanceled);
+
+            THEN("Neither the output nor the partial temporary file should be left behind")
+            {
+                REQUIRE_THROWS(PdfSaver{doc.getSaveData()}.save(destinationFile, options));
+                REQUIRE(childrenOf(directory).empty());
+            }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Slicer;
+
+SCENARIO("Saving a document to a memory buffer")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        WHEN("It's saved to a memory buffer")
+        {
+            std::vector<unsigned char> buffer;
+            PdfSaver{doc.getSaveData()}.saveToBuffer(buffer, PdfSaver::SaveOptions{});
+
+            THEN("The buffer should hold a PDF file with every page of the document")
+            {
+                QPDF saved;
+                saved.processMemoryFile("buffer",
+                                        reinterpret_cast<const char*>(buffer.data()),
+                                        buffer.size());
+
+                REQUIRE(saved.getAllPages().size() == 15);
+            }
+        }
+    }
+}
+
+#ifndef _WIN32
+SCENARIO("Saving a document to a file descriptor")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        WHEN("It's saved to a pipe while another thread reads from it")
+        {
+            int pipeDescriptors[2];
+            REQUIRE(pipe(pipeDescriptors) == 0);
+
+            std::string received;
+            std::thread reader{[&received, readDescriptor = pipeDescriptors[0]]() {
+                char chunk[4096];
+
+                for (ssize_t length = read(readDescriptor, chunk, sizeof(chunk)); length > 0;
+                     length = read(readDescriptor, chunk, sizeof(chunk)))
+                    received.append(chunk, static_cast<std::size_t>(length));
+            }};
+
+            PdfSaver::SaveOptions options;
+            options.sync = PdfSaver::SyncPolicy::File;
+            PdfSaver{doc.getSaveData()}.saveToDescriptor(pipeDescriptors[1], options);
+            close(pipeDescriptors[1]);
+            reader.join();
+            close(pipeDescriptors[0]);
+
+            THEN("The other end should receive a PDF file with every page of the document")
+            {
+                QPDF saved;
+                saved.processMemoryFile("pipe", received.data(), received.size());
+
+                REQUIRE(saved.getAllPages().size() == 15);
+            }
+        }
+
+        WHEN("It's saved to the descriptor of a regular file")
+        {
+            const ScratchFile destinationFile;
+            const int descriptor = open(destinationFile->get_path().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            REQUIRE(descriptor >= 0);
+
+            PdfSaver::SaveOptions options;
+            options.sync = PdfSaver::SyncPolicy::File;
+            PdfSaver{doc.getSaveData()}.saveToDescriptor(descriptor, options);
+            close(descriptor);
+
+            THEN("The file should hold every page of the document")
+            REQUIRE(openInMemory(destinationFile)->getAllPages().size() == 15);
+        }
+    }
+}
+#endif
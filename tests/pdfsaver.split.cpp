@@ -0,0 +1,43 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Splitting a document into several files")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        const ScratchFile firstFile;
+        const ScratchFile secondFile;
+        const ScratchFile thirdFile;
+
+        WHEN("It's split into 3 files of 5 pages, the first of them rotated")
+        {
+            doc.rotatePagesRight({0, 1, 2, 3, 4});
+
+            const std::vector<PdfSaver::SplitOutput> outputs = {{0, 4, firstFile},
+                                                                {5, 9, secondFile},
+                                                                {10, 14, thirdFile}};
+            PdfSaver{doc.getSaveData()}.saveSplit(outputs, PdfSaver::SaveOptions{});
+
+            THEN("Every file should have 5 pages")
+            {
+                for (const PdfSaver::SplitOutput& output : outputs)
+                    REQUIRE(openInMemory(output.destinationFile)->getAllPages().size() == 5);
+            }
+        }
+
+        WHEN("An output goes past the last page")
+        {
+            const std::vector<PdfSaver::SplitOutput> outputs = {{10, 15, firstFile}};
+
+            THEN("Nothing should be saved")
+            {
+                REQUIRE_THROWS(PdfSaver{doc.getSaveData()}.saveSplit(outputs, PdfSaver::SaveOptions{}));
+                REQUIRE_FALSE(firstFile->query_exists());
+            }
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Streaming the inputs of a merge")
+{
+    GIVEN("A document made of two merged PDF files")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+        doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+        doc.movePage(0, 7);
+        doc.rotatePagesRight({3});
+
+        PdfSaver::SaveOptions options;
+        options.streamInputs = true;
+
+        WHEN("It's saved with streamed inputs")
+        {
+            std::unique_ptr<QPDF> saved = saveAndOpen(doc, options);
+
+            THEN("The saved file should have every page of the document")
+            {
+                REQUIRE(saved->getAllPages().size() == doc.numberOfPages());
+            }
+
+            THEN("Every page should keep its content")
+            {
+                for (QPDFObjectHandle& page : saved->getAllPages()) {
+                    for (QPDFObjectHandle& content : page.getPageContents())
+                        REQUIRE(content.getStreamData()->getSize() > 0);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+#include <qpdf/QPDFWriter.hh>
+
+using namespace Slicer;
+
+SCENARIO("Keeping a few pages out of a bigger document")
+{
+    GIVEN("A multipage PDF document with 15 pages")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        WHEN("Only 3 of its pages are kept, and one of them is rotated")
+        {
+            doc.removePageRange(3, 14);
+            doc.rotatePagesRight({1});
+
+            std::vector<unsigned char> buffer;
+            PdfSaver{doc.getSaveData()}.saveToBuffer(buffer, PdfSaver::SaveOptions{});
+
+            QPDF saved;
+            saved.processMemoryFile("buffer",
+                                    reinterpret_cast<const char*>(buffer.data()),
+                                    buffer.size());
+            std::vector<QPDFObjectHandle> pages = saved.getAllPages();
+
+            THEN("The saved file should have those 3 pages")
+            REQUIRE(pages.size() == 3);
+
+            THEN("Every page should have its inherited attributes")
+            {
+                for (QPDFObjectHandle& page : pages) {
+                    REQUIRE(page.hasKey("/MediaBox"));
+                    REQUIRE(page.hasKey("/Resources"));
+                }
+            }
+
+            THEN("The rotated page should keep its rotation")
+            REQUIRE(pages.at(1).getKey("/Rotate").getIntValue() == 90);
+        }
+    }
+}
+
+static QPDFObjectHandle makeOutlineItem(QPDF& pdf, QPDFObjectHandle parent, const std::string& title, QPDFObjectHandle page)
+{
+    QPDFObjectHandle destination = QPDFObjectHandle::newArray();
+    destination.appendItem(page);
+    destination.appendItem(QPDFObjectHandle::newName("/Fit"));
+
+    QPDFObjectHandle item = QPDFObjectHandle::newDictionary();
+    item.replaceKey("/Title", QPDFObjectHandle::newUnicodeString(title));
+    item.replaceKey("/Parent", parent);
+    item.replaceKey("/Dest", destination);
+
+    return pdf.makeIndirectObject(item);
+}
+
+// A text field that is its own widget
+static QPDFObjectHandle makeField(QPDF& pdf, const std::string& name, QPDFObjectHandle page)
+{
+    QPDFObjectHandle field = QPDFObjectHandle::newDictionary();
+    field.replaceKey("/Type", QPDFObjectHandle::newName("/Annot"));
+    field.replaceKey("/Subtype", QPDFObjectHandle::newName("/Widget"));
+    field.replaceKey("/FT", QPDFObjectHandle::newName("/Tx"));
+    field.replaceKey("/T", QPDFObjectHandle::newUnicodeString(name));
+    field.replaceKey("/Rect", QPDFObjectHandle::newArray(QPDFObjectHandle::Rectangle{0, 0, 100, 20}));
+    field.replaceKey("/P", page);
+    field = pdf.makeIndirectObject(field);
+
+    QPDFObjectHandle annotations = page.getKey("/Annots");
+
+    if (!annotations.isArray())
+        annotations = QPDFObjectHandle::newArray();
+
+    annotations.appendItem(field);
+    page.replaceKey("/Annots", annotations);
+
+    return field;
+}
+
+SCENARIO("Keeping the catalog of a document when only a few of its pages are kept")
+{
+    GIVEN("A multipage PDF document with 15 pages, a language, an outline and a form")
+    {
+        QPDF original;
+        original.processFile(multipage1Path.c_str());
+        std::vector<QPDFObjectHandle> originalPages = original.getAllPages();
+
+        QPDFObjectHandle outlines = original.makeIndirectObject(QPDFObjectHandle::newDictionary());
+        QPDFObjectHandle firstItem = makeOutlineItem(original, outlines, "Kept", originalPages.at(0));
+        QPDFObjectHandle lastItem = makeOutlineItem(original, outlines, "Removed", originalPages.at(10));
+        firstItem.replaceKey("/Next", lastItem);
+        lastItem.replaceKey("/Prev", firstItem);
+        outlines.replaceKey("/Type", QPDFObjectHandle::newName("/Outlines"));
+        outlines.replaceKey("/First", firstItem);
+        outlines.replaceKey("/Last", lastItem);
+        outlines.replaceKey("/Count", QPDFObjectHandle::newInteger(2));
+        original.getRoot().replaceKey("/Outlines", outlines);
+        original.getRoot().replaceKey("/Lang", QPDFObjectHandle::newString("en"));
+
+        QPDFObjectHandle fields = QPDFObjectHandle::newArray();
+        fields.appendItem(makeField(original, "Kept", originalPages.at(0)));
+        fields.appendItem(makeField(original, "Removed", originalPages.at(10)));
+        QPDFObjectHandle form = QPDFObjectHandle::newDictionary();
+        form.replaceKey("/Fields", fields);
+        original.getRoot().replaceKey("/AcroForm", original.makeIndirectObject(form));
+
+        const ScratchFile originalFile;
+        QPDFWriter writer{original, originalFile->get_path().c_str()};
+        writer.write();
+
+        Document doc{originalFile};
+
+        WHEN("Only 3 of its pages are kept")
+        {
+            doc.removePageRange(3, 14);
+
+            std::vector<unsigned char> buffer;
+            PdfSaver{doc.getSaveData()}.saveToBuffer(buffer, PdfSaver::SaveOptions{});
+
+            QPDF saved;
+            saved.processMemoryFile("buffer",
+                                    reinterpret_cast<const char*>(buffer.data()),
+                                    buffer.size());
+            std::vector<QPDFObjectHandle> pages = saved.getAllPages();
+            QPDFObjectHandle savedOutlines = saved.getRoot().getKey("/Outlines");
+
+            THEN("The saved file should keep the language")
+            REQUIRE(saved.getRoot().getKey("/Lang").getUTF8Value() == "en");
+
+            THEN("The outline item of a kept page should point to its copy")
+            {
+                QPDFObjectHandle destination = savedOutlines.getKey("/First").getKey("/Dest");
+                REQUIRE(destination.getArrayItem(0).getObjGen() == pages.at(0).getObjGen());
+            }
+
+            THEN("The form should only keep the field of a kept page")
+            {
+                QPDFObjectHandle savedFields = saved.getRoot().getKey("/AcroForm").getKey("/Fields");
+
+                REQUIRE(savedFields.getArrayNItems() == 1);
+                REQUIRE(savedFields.getArrayItem(0).getKey("/T").getUTF8Value() == "Kept");
+            }
+
+            THEN("The outline item of a removed page should point nowhere")
+            REQUIRE(savedOutlines.getKey("/Last").getKey("/Dest").getArrayItem(0).isNull());
+
+            THEN("The removed pages should not be pulled into the saved file")
+            REQUIRE(numberOfPageObjects(saved) == 3);
+        }
+
+        WHEN("It's merged with another file with streamed inputs")
+        {
+            doc.addFile(Gio::File::create_for_path(multipage2Path), doc.numberOfPages());
+
+            PdfSaver::SaveOptions options;
+            options.streamInputs = true;
+
+            std::unique_ptr<QPDF> saved = saveAndOpen(doc, options);
+            QPDFObjectHandle destination = saved->getRoot().getKey("/Outlines").getKey("/First").getKey("/Dest");
+
+            THEN("The saved file should keep the language")
+            REQUIRE(saved->getRoot().getKey("/Lang").getUTF8Value() == "en");
+
+            THEN("The outline should point to the copies of the pages")
+            REQUIRE(destination.getArrayItem(0).getObjGen() == saved->getAllPages().at(0).getObjGen());
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "common.hpp"
+#include "pdfsaver.common.hpp"
+#include <catch.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Choosing where the output is written and how it's synced")
+{
+    GIVEN("A multipage PDF document and an empty destination directory")
+    {
+        Document doc{Gio::File::create_for_path(multipage1Path)};
+
+        const ScratchFile directory;
+        directory->make_directory();
+        Glib::RefPtr<Gio::File> destinationFile = directory->get_child("output.pdf");
+
+        // Looks for the temporary file while the output is being written
+        bool isWrittenNextToDestination = false;
+        PdfSaver::SaveOptions options;
+        options.onProgress = [&](const PdfSaver::SaveProgress&) {
+            for (const std::string& name : childrenOf(directory))
+                if (name.rfind(".output.pdf.", 0) == 0)
+                    isWrittenNextToDestination = true;
+        };
+
+        WHEN("It's saved with every sync policy")
+        {
+            THEN("Every save should produce the whole document")
+            {
+                for (const auto sync : {PdfSaver::SyncPolicy::None,
+                                        PdfSaver::SyncPolicy::File,
+                                        PdfSaver::SyncPolicy::FileAndDirectory}) {
+                    options.sync = sync;
+                    PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+                    QPDF saved;
+                    saved.processFile(destinationFile->get_path().c_str());
+
+                    REQUIRE(saved.getAllPages().size() == 15);
+                }
+            }
+        }
+
+        WHEN("It's saved next to the destination")
+        {
+            options.writeNextToDestination = true;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            THEN("The output should be written to a hidden file in the destination directory")
+            REQUIRE(isWrittenNextToDestination);
+
+            THEN("Only the output should be left in the directory")
+            REQUIRE(childrenOf(directory) == std::vector<std::string>{"output.pdf"});
+        }
+
+        WHEN("It's saved through the temporary directory")
+        {
+            options.writeNextToDestination = false;
+            PdfSaver{doc.getSaveData()}.save(destinationFile, options);
+
+            THEN("Nothing but the output should have been in the destination directory")
+            {
+                REQUIRE_FALSE(isWrittenNextToDestination);
+                REQUIRE(childrenOf(directory) == std::vector<std::string>{"output.pdf"});
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#include <catch.hpp>
+#include <future>
+#include <taskrunner.hpp>
+
+using namespace Slicer;
+
+SCENARIO("Idle work doesn't delay interactive work")
+{
+    GIVEN("A task runner whose idle threads are all busy, with more idle work queued")
+    {
+        TaskRunner taskRunner;
+
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::vector<Future<void>> idleWork;
+
+        for (int i = 0; i < 16; ++i)
+            idleWork.push_back(taskRunner.run([released]() { released.wait(); },
+                                              TaskRunner::defaultClient,
+                                              TaskRunner::Priority::Idle));
+
+        WHEN("An interactive task is run")
+        {
+            Future<int> interactive = taskRunner.run([]() {
+                return 42;
+            });
+
+            const int result = interactive.get();
+            const bool isIdleWorkDone = idleWork.back().isReady();
+
+            release.set_value();
+            whenAll(idleWork).get();
+
+            THEN("It should finish while the idle work is still waiting")
+            {
+                REQUIRE(result == 42);
+                REQUIRE_FALSE(isIdleWorkDone);
+            }
+        }
+    }
+}
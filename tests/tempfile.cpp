@@ -26,5 +26,45 @@ SCENARIO("Generated temporary files should be unique and isolated from the syste
                 REQUIRE(tempFile->get_parent()->get_basename() == config::APPLICATION_ID);
             }
         }
+
+        WHEN("A temporary file name is generated next to another file")
+        {
+            Glib::RefPtr<Gio::File> destinationFile = TempFile::generate();
+            Glib::RefPtr<Gio::File> tempFile = TempFile::generateNextTo(destinationFile);
+
+            THEN("It should be in the same directory as that file")
+            {
+                REQUIRE(tempFile->get_parent()->equal(destinationFile->get_parent()));
+            }
+
+            THEN("It should be a hidden file")
+            {
+                REQUIRE(tempFile->get_basename().front() == '.');
+            }
+
+            THEN("It should not be the same file")
+            {
+                REQUIRE_FALSE(tempFile->equal(destinationFile));
+            }
+        }
+
+        WHEN("A temporary file is written and synced")
+        {
+            Glib::RefPtr<Gio::File> tempFile = TempFile::generate();
+            tempFile->create_file()->write("%PDF-1.4");
+
+            THEN("It should be synced without errors")
+            REQUIRE_NOTHROW(TempFile::syncFile(tempFile));
+
+            tempFile->remove();
+        }
+
+#ifndef _WIN32
+        WHEN("A missing file is synced")
+        {
+            THEN("It should throw")
+            REQUIRE_THROWS(TempFile::syncFile(TempFile::generate()));
+        }
+#endif
     }
 }
@@ -1162,6 +1162,17 @@ private:
         return t;
     }
 
+    /**
+        *   Lock the queue mutex and
+        *   check if it's empty.
+        */
+    bool
+    _safe_queue_is_empty()
+    {
+        std::unique_lock<std::mutex> lock(_mutex_queue);
+        return _queue.empty();
+    }
+
     /**
         *   Called when the ThreadPool is created 
         *   or the user has required a resize 
@@ -1229,8 +1240,13 @@ private:
             }
             auto funcf = _safe_queue_pop();
             if (!funcf) {
-                if (_threads_blocker.thread_wait(&sem))
+                if (_threads_blocker.thread_wait(&sem)) {
+                    // A job pushed between the pop and the registration
+                    // above found no one to wake up, so check again
+                    if (!_safe_queue_is_empty())
+                        _threads_blocker.unblock();
                     sem.wait();
+                }
                 continue;
             }
             try {